@@ -0,0 +1,473 @@
+/*
+ * File:   command.c
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 16:05
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "usb\usb_device.h"
+#include "usb\usb_device_cdc.h"
+#include "protocol.h"
+#include "command.h"
+#include "telemetry.h"
+#include "history.h"
+#include "config.h"
+
+#if (CDC_CMD_DATA_IN_EP_SIZE < PROTOCOL_FRAME_MAX)
+# error "A response frame must fit in one CDC IN packet."
+#endif
+#if (PROTOCOL_VENDOR_REQUEST_LEN_MAX != 4)
+# error "wValue and wIndex carry four bytes of vendor request payload."
+#endif
+
+/********************************************************
+ * TYPES
+ *******************************************************/
+
+/* A command handler: takes the request payload and returns a
+ * PROTOCOL_STATUS_xxx code; if that is PROTOCOL_STATUS_OK it
+ * will have written the command's response data into pData */
+typedef uint8_t (*COMMAND_HANDLER)(const uint8_t *pRequest, uint8_t *pData);
+
+/* An entry in the command table */
+typedef struct
+{
+    uint8_t command;
+    uint8_t requestLength;
+    uint8_t responseLength;
+    COMMAND_HANDLER pHandler;
+} COMMAND;
+
+/********************************************************
+ * STATIC FUNCTION PROTOTYPES
+ *******************************************************/
+
+static uint8_t getStatus(const uint8_t *pRequest, uint8_t *pData);
+static uint8_t getSchedule(const uint8_t *pRequest, uint8_t *pData);
+static uint8_t setSchedule(const uint8_t *pRequest, uint8_t *pData);
+static uint8_t getCounters(const uint8_t *pRequest, uint8_t *pData);
+static uint8_t motorTest(const uint8_t *pRequest, uint8_t *pData);
+static uint8_t setTelemetry(const uint8_t *pRequest, uint8_t *pData);
+static uint8_t getHistory(const uint8_t *pRequest, uint8_t *pData);
+static uint8_t getUsbLoad(const uint8_t *pRequest, uint8_t *pData);
+static void dropFrame(void);
+static const COMMAND *findCommand(uint8_t command);
+static uint8_t runCommand(const COMMAND *pCommand, uint8_t requestLength,
+                          const uint8_t *pRequest, uint8_t *pPayload);
+static bool receiveFrame(void);
+static uint8_t handleFrame(const COMMAND *pCommand, uint8_t *pTxBuffer);
+
+/********************************************************
+ * PRIVATE VARIABLES
+ *******************************************************/
+
+/* The commands, in program memory */
+static const COMMAND commandTable[] =
+{
+    {PROTOCOL_CMD_GET_STATUS,    0,                              PROTOCOL_GET_STATUS_RSP_LEN,   getStatus},
+    {PROTOCOL_CMD_GET_SCHEDULE,  0,                              PROTOCOL_GET_SCHEDULE_RSP_LEN, getSchedule},
+    {PROTOCOL_CMD_SET_SCHEDULE,  PROTOCOL_SET_SCHEDULE_REQ_LEN,  0,                             setSchedule},
+    {PROTOCOL_CMD_GET_COUNTERS,  0,                              PROTOCOL_GET_COUNTERS_RSP_LEN, getCounters},
+    {PROTOCOL_CMD_MOTOR_TEST,    PROTOCOL_MOTOR_TEST_REQ_LEN,    0,                             motorTest},
+    {PROTOCOL_CMD_SET_TELEMETRY, PROTOCOL_SET_TELEMETRY_REQ_LEN, 0,                             setTelemetry},
+    {PROTOCOL_CMD_GET_HISTORY,   PROTOCOL_GET_HISTORY_REQ_LEN,   PROTOCOL_GET_HISTORY_RSP_LEN,  getHistory},
+    {PROTOCOL_CMD_GET_USB_LOAD,  0,                              PROTOCOL_GET_USB_LOAD_RSP_LEN, getUsbLoad}
+};
+
+/* The request being received: bytes are read from the command
+ * port straight into place and the handlers work on them
+ * there.  The requests behind it wait in the command port's
+ * receive ring and, once that is full, at the host, NAKed */
+static uint8_t frame[PROTOCOL_REQUEST_FRAME_MAX];
+static uint8_t frameLength = 0;
+/* Set when frame[] holds a complete, checked, request */
+static bool frameReady = false;
+/* Frames thrown away because of a bad CRC or LEN */
+static uint16_t droppedFrames = 0;
+/* A vendor request on the control endpoint waiting for the main
+ * loop: the command, its payload, copied from the setup packet
+ * before the next one overwrites it, and the reply, which the
+ * stack sends from where it is; GET_COUNTERS is the longest */
+static volatile bool vendorPending = false;
+static uint8_t vendorCommand;
+static uint8_t vendorRequest[PROTOCOL_VENDOR_REQUEST_LEN_MAX];
+static uint8_t vendorReply[1 + PROTOCOL_GET_COUNTERS_RSP_LEN];
+/* The length of the reply, 0 once it has gone */
+static uint8_t vendorReplyLength = 0;
+/* Set while the reply waits for the configuration to be
+ * committed to flash, and read back, before it is sent */
+static bool vendorCommitting = false;
+
+/********************************************************
+ * STATIC FUNCTIONS
+ *******************************************************/
+
+/* PROTOCOL_CMD_GET_STATUS */
+static uint8_t getStatus(const uint8_t *pRequest, uint8_t *pData)
+{
+    uint16_t periodsRemaining;
+
+    pData[0] = PROTOCOL_VERSION;
+    pData[1] = appGetStatus(&periodsRemaining);
+    PROTOCOL_PUT_UINT16(pData + 2, periodsRemaining);
+
+    return PROTOCOL_STATUS_OK;
+}
+
+/* PROTOCOL_CMD_GET_SCHEDULE */
+static uint8_t getSchedule(const uint8_t *pRequest, uint8_t *pData)
+{
+    uint16_t periods;
+    uint16_t motorMs;
+
+    appGetSchedule(&periods, &motorMs);
+    PROTOCOL_PUT_UINT16(pData, periods);
+    PROTOCOL_PUT_UINT16(pData + 2, motorMs);
+
+    return PROTOCOL_STATUS_OK;
+}
+
+/* PROTOCOL_CMD_SET_SCHEDULE */
+static uint8_t setSchedule(const uint8_t *pRequest, uint8_t *pData)
+{
+    uint16_t periods = PROTOCOL_GET_UINT16(pRequest);
+    uint16_t motorMs = PROTOCOL_GET_UINT16(pRequest + 2);
+
+    if ((periods < PROTOCOL_PERIODS_MIN) ||
+        (motorMs < PROTOCOL_MOTOR_MS_MIN) || (motorMs > PROTOCOL_MOTOR_MS_MAX))
+    {
+        return PROTOCOL_STATUS_BAD_VALUE;
+    }
+    appSetSchedule(periods, motorMs);
+
+    return PROTOCOL_STATUS_OK;
+}
+
+/* PROTOCOL_CMD_GET_COUNTERS */
+static uint8_t getCounters(const uint8_t *pRequest, uint8_t *pData)
+{
+    uint16_t waterings;
+    uint16_t faults;
+    CDC_TX_COUNTERS txCounters;
+
+    appGetCounters(&waterings, &faults);
+    getUSBUSARTTxCounters(&txCounters, false);
+    PROTOCOL_PUT_UINT16(pData, waterings);
+    PROTOCOL_PUT_UINT16(pData + 2, faults);
+    PROTOCOL_PUT_UINT16(pData + 4, USBUSARTTxOverflowCount());
+    PROTOCOL_PUT_UINT16(pData + 6, droppedFrames);
+    PROTOCOL_PUT_UINT32(pData + 8, txCounters.packets);
+    PROTOCOL_PUT_UINT32(pData + 12, txCounters.bytes);
+
+    return PROTOCOL_STATUS_OK;
+}
+
+/* PROTOCOL_CMD_MOTOR_TEST */
+static uint8_t motorTest(const uint8_t *pRequest, uint8_t *pData)
+{
+    uint16_t milliseconds = PROTOCOL_GET_UINT16(pRequest);
+
+    if ((milliseconds < PROTOCOL_MOTOR_MS_MIN) || (milliseconds > PROTOCOL_MOTOR_MS_MAX))
+    {
+        return PROTOCOL_STATUS_BAD_VALUE;
+    }
+    if (!appMotorTest(milliseconds))
+    {
+        return PROTOCOL_STATUS_BUSY;
+    }
+
+    return PROTOCOL_STATUS_OK;
+}
+
+/* PROTOCOL_CMD_SET_TELEMETRY */
+static uint8_t setTelemetry(const uint8_t *pRequest, uint8_t *pData)
+{
+    uint16_t milliseconds = PROTOCOL_GET_UINT16(pRequest);
+
+    if ((milliseconds != 0) && (milliseconds < PROTOCOL_TELEMETRY_MS_MIN))
+    {
+        return PROTOCOL_STATUS_BAD_VALUE;
+    }
+    telemetrySetInterval(milliseconds);
+
+    return PROTOCOL_STATUS_OK;
+}
+
+/* PROTOCOL_CMD_GET_HISTORY */
+static uint8_t getHistory(const uint8_t *pRequest, uint8_t *pData)
+{
+    uint16_t count;
+
+    if (historyPending())
+    {
+        return PROTOCOL_STATUS_BUSY;
+    }
+    count = historyStart(PROTOCOL_GET_UINT16(pRequest));
+    PROTOCOL_PUT_UINT16(pData, count);
+
+    return PROTOCOL_STATUS_OK;
+}
+
+/* PROTOCOL_CMD_GET_USB_LOAD */
+static uint8_t getUsbLoad(const uint8_t *pRequest, uint8_t *pData)
+{
+    uint32_t interrupts = 0;
+    uint32_t cycles = 0;
+
+#if defined(SYSTEM_MEASURE_USB_LOAD)
+    /* Copied with the USB interrupt, which adds to them, held off */
+    USBMaskInterrupts();
+    interrupts = SYSTEM_UsbLoad.interrupts;
+    cycles = SYSTEM_UsbLoad.cycles;
+    USBUnmaskInterrupts();
+#endif
+    PROTOCOL_PUT_UINT32(pData, interrupts);
+    PROTOCOL_PUT_UINT32(pData + 4, cycles);
+
+    return PROTOCOL_STATUS_OK;
+}
+
+/* Throw away the frame being received and look for the
+ * next SYNC */
+static void dropFrame(void)
+{
+    frameLength = 0;
+    if (droppedFrames < 0xFFFF)
+    {
+        droppedFrames++;
+    }
+}
+
+/* Find a command in the command table, NULL if it's not there */
+static const COMMAND *findCommand(uint8_t command)
+{
+    uint8_t x;
+
+    for (x = 0; x < sizeof(commandTable) / sizeof(commandTable[0]); x++)
+    {
+        if (commandTable[x].command == command)
+        {
+            return &(commandTable[x]);
+        }
+    }
+
+    return NULL;
+}
+
+/* Read as much of the next request as has arrived, returning
+ * true once frame[] holds all of it with a good CRC */
+static bool receiveFrame(void)
+{
+    uint8_t total;
+
+    if (frameReady)
+    {
+        return true;
+    }
+
+    /* Skip anything that isn't the start of a frame */
+    while (frameLength == 0)
+    {
+        if (readCmdUSBUSART(frame, 1) == 0)
+        {
+            return false;
+        }
+        if (frame[0] == PROTOCOL_SYNC)
+        {
+            frameLength = 1;
+        }
+    }
+
+    /* LEN says how much more there is to come */
+    if (frameLength == 1)
+    {
+        if (readCmdUSBUSART(frame + PROTOCOL_OFFSET_LEN, 1) == 0)
+        {
+            return false;
+        }
+        if ((frame[PROTOCOL_OFFSET_LEN] < 2) ||
+            (frame[PROTOCOL_OFFSET_LEN] > PROTOCOL_REQUEST_FRAME_MAX - PROTOCOL_OVERHEAD + 2))
+        {
+            dropFrame();
+            return false;
+        }
+        frameLength = 2;
+    }
+
+    /* Take as much of the rest as has arrived */
+    total = frame[PROTOCOL_OFFSET_LEN] + PROTOCOL_OVERHEAD - 2;
+    frameLength += readCmdUSBUSART(frame + frameLength, total - frameLength);
+    if (frameLength < total)
+    {
+        return false;
+    }
+
+    if (protocolCrc16(0xFFFF, frame + PROTOCOL_OFFSET_LEN, frame[PROTOCOL_OFFSET_LEN] + 1) !=
+        PROTOCOL_GET_UINT16(frame + total - 2))
+    {
+        dropFrame();
+        return false;
+    }
+    frameReady = true;
+
+    return true;
+}
+
+/* Run the handler for pCommand (NULL if it is unknown) on a
+ * request payload and write the response payload, status
+ * then data, into pPayload, returning its length */
+static uint8_t runCommand(const COMMAND *pCommand, uint8_t requestLength,
+                          const uint8_t *pRequest, uint8_t *pPayload)
+{
+    uint8_t status = PROTOCOL_STATUS_UNKNOWN_COMMAND;
+    uint8_t dataLength = 0;
+
+    if (pCommand != NULL)
+    {
+        status = PROTOCOL_STATUS_BAD_LENGTH;
+        if (requestLength == pCommand->requestLength)
+        {
+            status = pCommand->pHandler(pRequest, pPayload + 1);
+        }
+        if (status == PROTOCOL_STATUS_OK)
+        {
+            dataLength = pCommand->responseLength;
+        }
+    }
+    pPayload[0] = status;
+
+    return dataLength + 1;
+}
+
+/* Run the complete request in frame[], which is for pCommand,
+ * and build the response in pTxBuffer, returning its length */
+static uint8_t handleFrame(const COMMAND *pCommand, uint8_t *pTxBuffer)
+{
+    uint8_t length;
+
+    length = runCommand(pCommand, frame[PROTOCOL_OFFSET_LEN] - 2,
+                        frame + PROTOCOL_OFFSET_PAYLOAD,
+                        pTxBuffer + PROTOCOL_OFFSET_PAYLOAD);
+
+    return protocolFrameEnd(pTxBuffer, frame[PROTOCOL_OFFSET_TAG],
+                            frame[PROTOCOL_OFFSET_CMD] | PROTOCOL_RESPONSE,
+                            length);
+}
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Handle the requests that have been received, in order, for
+ * as long as their responses fit in pTxBuffer */
+uint8_t commandService(uint8_t *pTxBuffer)
+{
+    const COMMAND *pCommand;
+    uint8_t length = 0;
+    uint8_t responseLength;
+
+    while (receiveFrame())
+    {
+        /* A request whose response doesn't fit stays in frame[]
+         * until the next buffer */
+        pCommand = findCommand(frame[PROTOCOL_OFFSET_CMD]);
+        responseLength = PROTOCOL_OVERHEAD + 1;
+        if (pCommand != NULL)
+        {
+            responseLength += pCommand->responseLength;
+        }
+        if (length + responseLength > PROTOCOL_FRAME_MAX)
+        {
+            break;
+        }
+
+        length += handleFrame(pCommand, pTxBuffer + length);
+        frameReady = false;
+        frameLength = 0;
+    }
+
+    return length;
+}
+
+/* Take on a vendor request for one of our commands */
+void commandCheckVendorRequest(void)
+{
+    if ((SetupPkt.RequestType != USB_SETUP_TYPE_VENDOR_BITFIELD) ||
+        (SetupPkt.Recipient != USB_SETUP_RECIPIENT_DEVICE_BITFIELD) ||
+        (SetupPkt.DataDir != USB_SETUP_DEVICE_TO_HOST_BITFIELD) ||
+        (SetupPkt.bRequest < PROTOCOL_VENDOR_REQUEST_BASE) ||
+        (SetupPkt.bRequest >= PROTOCOL_VENDOR_REQUEST_BASE + PROTOCOL_RESPONSE) ||
+        (SetupPkt.wLength == 0))
+    {
+        return;
+    }
+
+    vendorCommand = SetupPkt.bRequest - PROTOCOL_VENDOR_REQUEST_BASE;
+    vendorRequest[0] = SetupPkt.W_Value.byte.LB;
+    vendorRequest[1] = SetupPkt.W_Value.byte.HB;
+    vendorRequest[2] = SetupPkt.W_Index.byte.LB;
+    vendorRequest[3] = SetupPkt.W_Index.byte.HB;
+    vendorPending = true;
+    vendorCommitting = false;
+    vendorReplyLength = 0;
+    /* The host is NAKed until commandVendorService() replies,
+     * which is once any change the request made is in flash */
+    USBDeferINDataStage();
+    USBDeferStatusStage();
+}
+
+/* Reply to a vendor request, in the main loop where the
+ * command handlers can safely touch the application's state */
+void commandVendorService(void)
+{
+    const COMMAND *pCommand;
+    uint8_t requestLength;
+    uint8_t length;
+
+    if (vendorPending)
+    {
+        /* Vendor requests carry all the payload a command can
+         * take; a command that takes less uses the start of it */
+        pCommand = findCommand(vendorCommand);
+        requestLength = sizeof(vendorRequest);
+        if ((pCommand != NULL) && (pCommand->requestLength < requestLength))
+        {
+            requestLength = pCommand->requestLength;
+        }
+        length = runCommand(pCommand, requestLength, vendorRequest, vendorReply);
+
+        USBMaskInterrupts();
+        vendorReplyLength = length;
+        vendorCommitting = configPending();
+        vendorPending = false;
+        USBUnmaskInterrupts();
+    }
+
+    /* Not until the change is in flash: configCommit() only
+     * clears configPending() once the record reads back */
+    if ((vendorReplyLength == 0) || (vendorCommitting && configPending()))
+    {
+        return;
+    }
+
+    /* Unless a bus reset or a new setup packet has done away
+     * with the request while it was waiting */
+    USBMaskInterrupts();
+    if (USBINDataStageDeferred())
+    {
+        USBEP0SendRAMPtr(vendorReply, vendorReplyLength, USB_EP0_NO_OPTIONS);
+        USBCtrlEPAllowDataStage();
+        USBCtrlEPAllowStatusStage();
+    }
+    vendorReplyLength = 0;
+    vendorCommitting = false;
+    USBUnmaskInterrupts();
+}
+
+/* Whether a vendor request's reply is waiting on configCommit() */
+bool commandVendorCommitting(void)
+{
+    return vendorCommitting;
+}
@@ -0,0 +1,67 @@
+/*
+ * File:   command.h
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 16:05
+ */
+
+#ifndef COMMAND_H
+#define	COMMAND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Parse whatever has been received on the command port, see
+ * protocol.h.  A request may arrive over any number of
+ * calls.  Complete requests are handled in order and their
+ * response frames written one after another into pTxBuffer,
+ * which must have room for PROTOCOL_FRAME_MAX bytes, e.g. the
+ * buffer returned by reserveCmdUSBUSART(), for as long as they
+ * fit.  The total length of the responses is returned, 0 if
+ * there are none */
+uint8_t commandService(uint8_t *pTxBuffer);
+
+/* Call on EVENT_EP0_REQUEST: if the setup packet is one of
+ * the vendor requests described in protocol.h, take it on,
+ * deferring the data and status stages until
+ * commandVendorService() replies */
+void commandCheckVendorRequest(void);
+
+/* Handle a vendor request taken on by
+ * commandCheckVendorRequest(), if there is one, and reply to
+ * it, unless that has left configPending() true, in which
+ * case the reply waits until a configCommit() has read back
+ * correctly, see commandVendorCommitting().  Call from the
+ * main loop rather than interrupt context, and often */
+void commandVendorService(void);
+
+/* Return true while the reply to a vendor request waits for
+ * the configuration to be committed; the caller should call
+ * configCommit() as soon as it can stall the CPU for it */
+bool commandVendorCommitting(void);
+
+/********************************************************
+ * FUNCTIONS PROVIDED BY THE APPLICATION
+ *******************************************************/
+
+/* Return the PROTOCOL_FLAG_xxx bits that apply now and the
+ * number of watchdog periods until the next watering */
+uint8_t appGetStatus(uint16_t *pPeriodsRemaining);
+
+/* Get/set the watering schedule, see PROTOCOL_CMD_SET_SCHEDULE;
+ * the values passed to appSetSchedule() have been range checked */
+void appGetSchedule(uint16_t *pPeriods, uint16_t *pMotorMs);
+void appSetSchedule(uint16_t periods, uint16_t motorMs);
+
+/* Get the application's counters */
+void appGetCounters(uint16_t *pWaterings, uint16_t *pFaults);
+
+/* Run the motor for the given (range checked) time, returning
+ * false if it can't be done now */
+bool appMotorTest(uint16_t milliseconds);
+
+#endif	/* COMMAND_H */
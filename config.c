@@ -0,0 +1,151 @@
+/*
+ * File:   config.c
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 21:45
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "flash.h"
+#include "protocol.h"
+#include "config.h"
+
+/********************************************************
+ * MACROS
+ *******************************************************/
+
+// The record goes in one of two slots, each a row of HEF,
+// each new record overwriting the older slot
+#define CONFIG_NUM_SLOTS   2
+#define CONFIG_SLOT_START  FLASH_HEF_START
+
+#if (CONFIG_SLOT_START + CONFIG_NUM_SLOTS * FLASH_ROW_WORDS - 1 > FLASH_HEF_END)
+# error "The configuration slots must fit in HEF."
+#endif
+
+/********************************************************
+ * TYPES
+ *******************************************************/
+
+/* A configuration record as it is stored: the sequence
+ * number says which slot is newer and the CRC, a
+ * CRC-16/CCITT-FALSE, covers everything before it */
+typedef struct
+{
+    uint8_t version;
+    uint8_t sequence;
+    CONFIG config;
+    uint16_t crc;
+} CONFIG_RECORD;
+
+/********************************************************
+ * STATIC FUNCTION PROTOTYPES
+ *******************************************************/
+
+static bool readSlot(uint8_t slot, CONFIG_RECORD *pRecord);
+
+/********************************************************
+ * PRIVATE VARIABLES
+ *******************************************************/
+
+/* The slot holding the newest good record and its
+ * sequence number, or CONFIG_NUM_SLOTS if there isn't one */
+static uint8_t currentSlot = CONFIG_NUM_SLOTS;
+static uint8_t currentSequence = 0;
+/* The record waiting to be committed and whether there is one */
+static CONFIG pendingConfig;
+static bool pending = false;
+
+/********************************************************
+ * STATIC FUNCTIONS
+ *******************************************************/
+
+/* Read the record in a slot, returning true if it is good */
+static bool readSlot(uint8_t slot, CONFIG_RECORD *pRecord)
+{
+    flashRead(CONFIG_SLOT_START + slot * FLASH_ROW_WORDS, (uint8_t *) pRecord, sizeof(*pRecord));
+
+    return (pRecord->version == CONFIG_VERSION) &&
+           (pRecord->crc == protocolCrc16(0xFFFF, (const uint8_t *) pRecord,
+                                          sizeof(*pRecord) - sizeof(pRecord->crc)));
+}
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Read the newest good record */
+bool configLoad(CONFIG *pConfig)
+{
+    CONFIG_RECORD record;
+    uint8_t slot;
+
+    currentSlot = CONFIG_NUM_SLOTS;
+    for (slot = 0; slot < CONFIG_NUM_SLOTS; slot++)
+    {
+        /* Sequence numbers wrap, newer is less than half
+         * way round ahead */
+        if (readSlot(slot, &record) &&
+            ((currentSlot == CONFIG_NUM_SLOTS) || ((int8_t) (record.sequence - currentSequence) > 0)))
+        {
+            currentSlot = slot;
+            currentSequence = record.sequence;
+            *pConfig = record.config;
+        }
+    }
+
+    return (currentSlot < CONFIG_NUM_SLOTS);
+}
+
+/* Keep a copy for later */
+void configSave(const CONFIG *pConfig)
+{
+    pendingConfig = *pConfig;
+    pending = true;
+}
+
+/* Whether there is a record waiting */
+bool configPending(void)
+{
+    return pending;
+}
+
+/* Write the waiting record over the older slot */
+bool configCommit(void)
+{
+    CONFIG_RECORD record;
+    uint8_t slot = 0;
+
+    if (!pending)
+    {
+        return true;
+    }
+
+    if (currentSlot < CONFIG_NUM_SLOTS)
+    {
+        slot = currentSlot + 1;
+        if (slot >= CONFIG_NUM_SLOTS)
+        {
+            slot = 0;
+        }
+    }
+
+    record.version = CONFIG_VERSION;
+    record.sequence = currentSequence + 1;
+    record.config = pendingConfig;
+    record.crc = protocolCrc16(0xFFFF, (const uint8_t *) &record,
+                               sizeof(record) - sizeof(record.crc));
+    flashEraseRow(CONFIG_SLOT_START + slot * FLASH_ROW_WORDS);
+    flashWrite(CONFIG_SLOT_START + slot * FLASH_ROW_WORDS, (const uint8_t *) &record, sizeof(record));
+
+    if (!readSlot(slot, &record))
+    {
+        return false;
+    }
+    currentSlot = slot;
+    currentSequence = record.sequence;
+    pending = false;
+
+    return true;
+}
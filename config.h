@@ -0,0 +1,62 @@
+/*
+ * File:   config.h
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 21:45
+ */
+
+#ifndef CONFIG_H
+#define	CONFIG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/********************************************************
+ * MACROS
+ *******************************************************/
+
+// Bumped when CONFIG changes, so that a record written by
+// older code is ignored rather than misread
+#define CONFIG_VERSION 1
+
+/********************************************************
+ * TYPES
+ *******************************************************/
+
+/* The settings kept in flash */
+typedef struct
+{
+    uint16_t wateringPeriods;
+    uint16_t motorMs;
+    uint16_t debounceMs;
+} CONFIG;
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Read the newest good configuration record from flash
+ * into pConfig, returning false and leaving pConfig alone,
+ * i.e. with its defaults, if there isn't one */
+bool configLoad(CONFIG *pConfig);
+
+/* Take a copy of pConfig to be written to flash as the
+ * newest record by configCommit(); nothing is written here.
+ * A reset before the commit loses the change */
+void configSave(const CONFIG *pConfig);
+
+/* Return true if configSave() has been called since the
+ * record was last committed */
+bool configPending(void);
+
+/* Write the record waiting from configSave(), if there is
+ * one, returning true if it reads back correctly, after
+ * which configPending() is false; if it doesn't the record
+ * stays waiting for another go.  The previous record stays
+ * intact until this one is complete, so a reset part way
+ * through loses the change but nothing else.  Stalls the
+ * CPU for around 4 ms, see flashEraseRow() and
+ * flashWrite(), so call when there is nothing else to do */
+bool configCommit(void);
+
+#endif	/* CONFIG_H */
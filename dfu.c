@@ -0,0 +1,107 @@
+/*
+ * File:   dfu.c
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 23:10
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "usb\usb_device.h"
+#include "usb\usb_device_cdc.h"
+#include "dfu.h"
+
+#if defined(USB_DFU_RUNTIME)
+
+/********************************************************
+ * MACROS
+ *******************************************************/
+
+// DFU 1.1 class requests, those used in run-time mode
+#define DFU_DETACH            0
+#define DFU_GETSTATUS         3
+#define DFU_GETSTATE          5
+
+// DFU_GETSTATUS: the response length and the states that
+// apply in run-time mode
+#define DFU_STATUS_LEN        6
+#define DFU_STATUS_OK         0
+#define DFU_STATE_APP_IDLE    0
+#define DFU_STATE_APP_DETACH  1
+
+/********************************************************
+ * PRIVATE VARIABLES
+ *******************************************************/
+
+/* The DFU_GETSTATUS response, sent from where it is:
+ * bStatus, bwPollTimeout (3), bState, iString */
+static uint8_t status[DFU_STATUS_LEN] = {DFU_STATUS_OK, 0, 0, 0, DFU_STATE_APP_IDLE, 0};
+
+/* Set by a DFU_DETACH, then when we started waiting to go */
+static volatile bool detachRequested = false;
+static bool detachTiming = false;
+static uint32_t detachStartMs;
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Answer DFU class requests */
+void dfuCheckRequest(void)
+{
+    if ((SetupPkt.RequestType != USB_SETUP_TYPE_CLASS_BITFIELD) ||
+        (SetupPkt.Recipient != USB_SETUP_RECIPIENT_INTERFACE_BITFIELD) ||
+        (SetupPkt.bIntfID != DFU_INTF_ID))
+    {
+        return;
+    }
+
+    /* Anything not claimed here is stalled by the stack */
+    switch (SetupPkt.bRequest)
+    {
+        case DFU_DETACH:
+            if (SetupPkt.DataDir == USB_SETUP_HOST_TO_DEVICE_BITFIELD)
+            {
+                status[4] = DFU_STATE_APP_DETACH;
+                detachRequested = true;
+                USBEP0Transmit(USB_EP0_NO_DATA);
+            }
+        break;
+
+        case DFU_GETSTATUS:
+            if (SetupPkt.DataDir == USB_SETUP_DEVICE_TO_HOST_BITFIELD)
+            {
+                USBEP0SendRAMPtr(status, sizeof(status), USB_EP0_INCLUDE_ZERO);
+            }
+        break;
+
+        case DFU_GETSTATE:
+            if (SetupPkt.DataDir == USB_SETUP_DEVICE_TO_HOST_BITFIELD)
+            {
+                USBEP0SendRAMPtr(status + 4, 1, USB_EP0_INCLUDE_ZERO);
+            }
+        break;
+
+        default:
+        break;
+    }
+}
+
+/* Count down to detaching */
+bool dfuService(uint32_t nowMs)
+{
+    if (!detachRequested)
+    {
+        return false;
+    }
+
+    if (!detachTiming)
+    {
+        detachStartMs = nowMs;
+        detachTiming = true;
+    }
+
+    return (nowMs - detachStartMs >= DFU_DETACH_DELAY_MS);
+}
+
+#endif // USB_DFU_RUNTIME
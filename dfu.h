@@ -0,0 +1,54 @@
+/*
+ * File:   dfu.h
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 23:10
+ */
+
+#ifndef DFU_H
+#define	DFU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* The run-time half of USB DFU 1.1: an interface, DFU_INTF_ID
+ * in usb_config.h, through which a DFU client such as dfu-util
+ * can ask the unit to detach and come back as a DFU device.
+ * The functional descriptor says we detach ourselves, so the
+ * host doesn't reset the bus, and doesn't claim download
+ * (bitCanDnload) since this firmware has no bootloader.
+ * Without one detaching is no use to a DFU client, so all
+ * of this is left out unless USB_DFU_RUNTIME is defined in
+ * usb_config.h.
+ *
+ * Detaching ends with a RESET instruction, which leaves PCON
+ * nRI clear.  A DFU bootloader at the reset vector takes that
+ * as the signal to enumerate in DFU mode, writing the download
+ * a row, DFU_TRANSFER_SIZE bytes, at a time; without one the
+ * unit comes straight back up as it was, with the reset in the
+ * history */
+
+/********************************************************
+ * MACROS
+ *******************************************************/
+
+// How long after DFU_DETACH before we drop off the bus,
+// long enough for the status stage to have gone
+#define DFU_DETACH_DELAY_MS   10
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Call on EVENT_EP0_REQUEST: if the setup packet is a DFU
+ * class request to the DFU interface, answer it; requests
+ * that only make sense in DFU mode are stalled */
+void dfuCheckRequest(void);
+
+/* Return true once it is time to detach, having been asked
+ * to; the caller must then put the hardware somewhere safe,
+ * call USBDeviceDetach() and RESET().  nowMs is the time
+ * now, in ms */
+bool dfuService(uint32_t nowMs);
+
+#endif	/* DFU_H */
@@ -0,0 +1,84 @@
+/*
+ * File:   events.c
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 10:12
+ */
+
+#include "events.h"
+
+/********************************************************
+ * PRIVATE VARIABLES
+ *******************************************************/
+
+static EVENT_RECORD queue[EVENTS_QUEUE_SIZE];
+static uint8_t head = 0;
+static uint8_t count = 0;
+static uint16_t nextSequence = 0;
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Add an event record to the queue, overwriting the oldest
+ * record if the queue is full */
+void eventsPush(EVENT_TYPE type)
+{
+    uint8_t x;
+
+    if (count < EVENTS_QUEUE_SIZE)
+    {
+        count++;
+    }
+    else
+    {
+        head++;
+        if (head >= EVENTS_QUEUE_SIZE)
+        {
+            head = 0;
+        }
+    }
+
+    x = head + count - 1;
+    if (x >= EVENTS_QUEUE_SIZE)
+    {
+        x -= EVENTS_QUEUE_SIZE;
+    }
+    queue[x].sequence = nextSequence;
+    queue[x].type = type;
+    nextSequence++;
+}
+
+/* Take the oldest event record from the queue, returning
+ * false if there isn't one */
+bool eventsPop(EVENT_RECORD *pRecord)
+{
+    if (count == 0)
+    {
+        return false;
+    }
+
+    *pRecord = queue[head];
+    head++;
+    if (head >= EVENTS_QUEUE_SIZE)
+    {
+        head = 0;
+    }
+    count--;
+
+    return true;
+}
+
+/* Return true if there is an event record queued */
+bool eventsPending(void)
+{
+    return (count > 0);
+}
+
+/* Throw away all of the queued event records; the sequence
+ * numbers carry on so the host can see that records were lost */
+void eventsFlush(void)
+{
+    head = 0;
+    count = 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * File:   events.h
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 10:12
+ */
+
+#ifndef EVENTS_H
+#define	EVENTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/********************************************************
+ * MACROS
+ *******************************************************/
+
+// The number of event records that can be queued; when
+// the queue is full the oldest record is overwritten
+#define EVENTS_QUEUE_SIZE 8
+
+/********************************************************
+ * TYPES
+ *******************************************************/
+
+/* The things that happen which the host wants to hear about */
+typedef enum
+{
+    EVENT_TYPE_WATERING_START,
+    EVENT_TYPE_WATERING_END,
+    MAX_NUM_EVENT_TYPES
+} EVENT_TYPE;
+
+/* An event record: the sequence number lets the host spot
+ * records that were overwritten before it read them */
+typedef struct
+{
+    uint16_t sequence;
+    EVENT_TYPE type;
+} EVENT_RECORD;
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+void eventsPush(EVENT_TYPE type);
+bool eventsPop(EVENT_RECORD *pRecord);
+bool eventsPending(void);
+void eventsFlush(void);
+
+#endif	/* EVENTS_H */
@@ -0,0 +1,111 @@
+/*
+ * File:   flash.c
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 21:45
+ */
+
+#include <xc.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "flash.h"
+
+/********************************************************
+ * STATIC FUNCTION PROTOTYPES
+ *******************************************************/
+
+static void unlock(void);
+
+/********************************************************
+ * STATIC FUNCTIONS
+ *******************************************************/
+
+/* The sequence that starts an erase or write; the CPU
+ * stalls until it is done.  Interrupts must be off */
+static void unlock(void)
+{
+    PMCON2 = 0x55;
+    PMCON2 = 0xAA;
+    PMCON1bits.WR = 1;
+    NOP();
+    NOP();
+}
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Read the low bytes of some words of flash.  Each read is
+ * done with interrupts off, since flash may also be read in
+ * interrupt context, e.g. to fill a CDC packet */
+void flashRead(uint16_t address, uint8_t *pData, uint8_t length)
+{
+    bool interruptsOn = INTCONbits.GIE;
+
+    while (length > 0)
+    {
+        INTCONbits.GIE = 0;
+        PMCON1bits.CFGS = 0;
+        PMADR = address;
+        PMCON1bits.RD = 1;
+        NOP();
+        NOP();
+        *pData = PMDATL;
+        INTCONbits.GIE = interruptsOn;
+        pData++;
+        address++;
+        length--;
+    }
+}
+
+/* Erase a row of flash */
+void flashEraseRow(uint16_t address)
+{
+    bool interruptsOn = INTCONbits.GIE;
+
+    INTCONbits.GIE = 0;
+    PMCON1bits.CFGS = 0;
+    PMADR = address;
+    PMCON1bits.FREE = 1;
+    PMCON1bits.WREN = 1;
+    unlock();
+    PMCON1bits.WREN = 0;
+    INTCONbits.GIE = interruptsOn;
+}
+
+/* Write some words of a row of flash */
+void flashWrite(uint16_t address, const uint8_t *pData, uint8_t length)
+{
+    bool interruptsOn = INTCONbits.GIE;
+    uint16_t row = address & ~(FLASH_ROW_WORDS - 1);
+    uint8_t x;
+
+    INTCONbits.GIE = 0;
+    PMCON1bits.CFGS = 0;
+    PMCON1bits.FREE = 0;
+    PMCON1bits.WREN = 1;
+
+    /* Load every write latch, all but the last without
+     * writing, then write the lot; words that aren't ours
+     * are loaded with the erased value, which leaves them
+     * as they are */
+    PMCON1bits.LWLO = 1;
+    for (x = 0; x < FLASH_ROW_WORDS; x++)
+    {
+        PMADR = row + x;
+        PMDATH = 0x3F;
+        PMDATL = 0xFF;
+        if ((row + x >= address) && (row + x < address + length))
+        {
+            PMDATL = pData[row + x - address];
+        }
+        if (x == FLASH_ROW_WORDS - 1)
+        {
+            PMCON1bits.LWLO = 0;
+        }
+        unlock();
+    }
+
+    PMCON1bits.WREN = 0;
+    INTCONbits.GIE = interruptsOn;
+}
@@ -0,0 +1,52 @@
+/*
+ * File:   flash.h
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 21:45
+ */
+
+#ifndef FLASH_H
+#define	FLASH_H
+
+#include <stdint.h>
+
+/********************************************************
+ * MACROS
+ *******************************************************/
+
+// The High-Endurance Flash: the last 128 words of program
+// memory, only the low byte of each word being high
+// endurance.  The configuration, see config.c, is at the
+// start and the serial number, see serial.c, in the last row
+#define FLASH_HEF_START       0x1F80
+#define FLASH_HEF_END         0x1FFF
+
+// Ordinary flash below HEF, also used for data.  This and HEF
+// are kept out of the linker's way with the ROM ranges in the
+// project, default,-1e80-1fff
+#define FLASH_DATA_START      0x1E80
+
+// Flash is erased and written a row at a time
+#define FLASH_ROW_WORDS       32
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Read the low bytes of length words of flash, starting
+ * at address, into pData */
+void flashRead(uint16_t address, uint8_t *pData, uint8_t length);
+
+/* Erase the row at address, which must be the start of a
+ * row.  The CPU stalls for around 2 ms while this happens,
+ * with interrupts held off */
+void flashEraseRow(uint16_t address);
+
+/* Write length bytes of pData into the low bytes of the
+ * words from address on, which must be erased and all in
+ * the same row; the rest of the row is left as it is.  The
+ * CPU stalls for around 2 ms while this happens, with
+ * interrupts held off */
+void flashWrite(uint16_t address, const uint8_t *pData, uint8_t length);
+
+#endif	/* FLASH_H */
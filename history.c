@@ -0,0 +1,344 @@
+/*
+ * File:   history.c
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 22:30
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "usb\usb_device.h"
+#include "usb\usb_device_cdc.h"
+#include "flash.h"
+#include "protocol.h"
+#include "history.h"
+
+/********************************************************
+ * MACROS
+ *******************************************************/
+
+#define HISTORY_START              FLASH_DATA_START
+#define HISTORY_RECORDS_PER_ROW    (FLASH_ROW_WORDS / PROTOCOL_HISTORY_RECORD_LEN)
+#define HISTORY_NUM_RECORDS        (HISTORY_NUM_ROWS * HISTORY_RECORDS_PER_ROW)
+
+#if (HISTORY_START + HISTORY_NUM_ROWS * FLASH_ROW_WORDS > FLASH_HEF_START)
+# error "The history must fit below HEF."
+#endif
+#if (PROTOCOL_FRAME_MAX != PROTOCOL_OVERHEAD + 2 + PROTOCOL_HISTORY_RECORDS_MAX * PROTOCOL_HISTORY_RECORD_LEN)
+# error "Full history frames must fill a CDC packet exactly."
+#endif
+
+/********************************************************
+ * TYPES
+ *******************************************************/
+
+/* A record as it is stored and sent, see protocol.h; the
+ * check is the low byte of a CRC-16/CCITT-FALSE over the
+ * rest */
+typedef struct
+{
+    uint16_t sequence;
+    uint8_t type;
+    uint8_t arg;
+    uint8_t periods[3];
+    uint8_t check;
+} HISTORY_RECORD;
+
+/********************************************************
+ * STATIC FUNCTION PROTOTYPES
+ *******************************************************/
+
+static uint16_t address(uint8_t slot);
+static bool readRecord(uint8_t slot, HISTORY_RECORD *pRecord);
+static bool isErased(const HISTORY_RECORD *pRecord);
+static uint8_t produce(uint8_t *pBuffer, uint8_t length);
+
+/********************************************************
+ * PRIVATE VARIABLES
+ *******************************************************/
+
+/* Where the next record goes in flash and the sequence
+ * number of the next record added */
+static uint8_t nextSlot = 0;
+static uint16_t nextSequence = 0;
+
+/* The records waiting to be written, oldest at queueStart */
+static HISTORY_RECORD queue[HISTORY_QUEUE_LEN];
+static uint8_t queueStart = 0;
+static uint8_t queueCount = 0;
+
+/* The read-out: whether it's waiting to go or going, the
+ * slot it has got to, how many slots are left to look at,
+ * the oldest sequence number wanted, how many records are
+ * left to send and the TAG of the next frame */
+static bool streamPending = false;
+static bool streamActive = false;
+static uint8_t streamSlot;
+static uint8_t streamSlotsLeft;
+static uint16_t streamFrom;
+static uint16_t streamLeft;
+static uint8_t streamTag;
+
+/********************************************************
+ * STATIC FUNCTIONS
+ *******************************************************/
+
+/* The flash address of a record slot */
+static uint16_t address(uint8_t slot)
+{
+    return HISTORY_START + (uint16_t) slot * PROTOCOL_HISTORY_RECORD_LEN;
+}
+
+/* Read the record in a slot, returning true if it is good */
+static bool readRecord(uint8_t slot, HISTORY_RECORD *pRecord)
+{
+    flashRead(address(slot), (uint8_t *) pRecord, sizeof(*pRecord));
+
+    return (pRecord->type < MAX_NUM_HISTORY_TYPES) &&
+           (pRecord->check == (uint8_t) protocolCrc16(0xFFFF, (const uint8_t *) pRecord,
+                                                      sizeof(*pRecord) - 1));
+}
+
+/* Return true if a record slot has never been written */
+static bool isErased(const HISTORY_RECORD *pRecord)
+{
+    const uint8_t *pByte = (const uint8_t *) pRecord;
+    uint8_t x;
+
+    for (x = 0; x < sizeof(*pRecord); x++)
+    {
+        if (pByte[x] != 0xFF)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Fill a CDC packet with a PROTOCOL_HISTORY frame, reading the
+ * records from flash straight into place; may be called in
+ * interrupt context */
+static uint8_t produce(uint8_t *pBuffer, uint8_t length)
+{
+    HISTORY_RECORD *pRecord;
+    uint8_t count = 0;
+
+    /* After a last frame that filled the packet, a zero length
+     * packet ends the stream */
+    if (!streamActive || (length < PROTOCOL_FRAME_MAX))
+    {
+        return 0;
+    }
+
+    pRecord = (HISTORY_RECORD *) (pBuffer + PROTOCOL_OFFSET_PAYLOAD + 2);
+    while ((count < PROTOCOL_HISTORY_RECORDS_MAX) && (streamLeft > 0) && (streamSlotsLeft > 0))
+    {
+        /* Records may be added, and rows erased, as we go, in
+         * which case the host sees the gap in the sequence */
+        if (readRecord(streamSlot, pRecord) && ((int16_t) (pRecord->sequence - streamFrom) >= 0))
+        {
+            pRecord++;
+            count++;
+            streamLeft--;
+        }
+        streamSlot++;
+        if (streamSlot >= HISTORY_NUM_RECORDS)
+        {
+            streamSlot = 0;
+        }
+        streamSlotsLeft--;
+    }
+    if (streamSlotsLeft == 0)
+    {
+        streamLeft = 0;
+    }
+    if (streamLeft == 0)
+    {
+        streamActive = false;
+    }
+
+    PROTOCOL_PUT_UINT16(pBuffer + PROTOCOL_OFFSET_PAYLOAD, streamLeft);
+    length = protocolFrameEnd(pBuffer, streamTag, PROTOCOL_HISTORY,
+                              2 + count * PROTOCOL_HISTORY_RECORD_LEN);
+    streamTag++;
+
+    return length;
+}
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Carry on from the newest good record */
+void historyInit(void)
+{
+    HISTORY_RECORD record;
+    bool found = false;
+    uint8_t slot;
+
+    nextSlot = 0;
+    nextSequence = 0;
+    for (slot = 0; slot < HISTORY_NUM_RECORDS; slot++)
+    {
+        if (readRecord(slot, &record) &&
+            (!found || ((int16_t) (record.sequence - nextSequence) >= 0)))
+        {
+            found = true;
+            nextSlot = slot + 1;
+            nextSequence = record.sequence + 1;
+        }
+    }
+    if (nextSlot >= HISTORY_NUM_RECORDS)
+    {
+        nextSlot = 0;
+    }
+
+    /* If the power went while the next slot was being written
+     * it is no good to us; move on to the next row, which will
+     * be erased */
+    if ((nextSlot % HISTORY_RECORDS_PER_ROW) != 0)
+    {
+        flashRead(address(nextSlot), (uint8_t *) &record, sizeof(record));
+        if (!isErased(&record))
+        {
+            nextSlot += HISTORY_RECORDS_PER_ROW - (nextSlot % HISTORY_RECORDS_PER_ROW);
+            if (nextSlot >= HISTORY_NUM_RECORDS)
+            {
+                nextSlot = 0;
+            }
+        }
+    }
+}
+
+/* Add a record to the queue */
+void historyAdd(HISTORY_TYPE type, uint8_t arg, uint32_t periods)
+{
+    HISTORY_RECORD *pRecord;
+    uint8_t x;
+
+    /* Better a stall now than a lost record */
+    if (queueCount >= HISTORY_QUEUE_LEN)
+    {
+        historyCommit();
+    }
+
+    x = queueStart + queueCount;
+    if (x >= HISTORY_QUEUE_LEN)
+    {
+        x -= HISTORY_QUEUE_LEN;
+    }
+    pRecord = &(queue[x]);
+    pRecord->sequence = nextSequence;
+    pRecord->type = type;
+    pRecord->arg = arg;
+    pRecord->periods[0] = (uint8_t) periods;
+    pRecord->periods[1] = (uint8_t) (periods >> 8);
+    pRecord->periods[2] = (uint8_t) (periods >> 16);
+    pRecord->check = (uint8_t) protocolCrc16(0xFFFF, (const uint8_t *) pRecord, sizeof(*pRecord) - 1);
+    queueCount++;
+    nextSequence++;
+}
+
+/* Whether there are records waiting */
+bool historyQueued(void)
+{
+    return (queueCount > 0);
+}
+
+/* Write the oldest waiting record at the head of the log */
+void historyCommit(void)
+{
+    if (queueCount == 0)
+    {
+        return;
+    }
+
+    /* Starting a row means losing the oldest records */
+    if ((nextSlot % HISTORY_RECORDS_PER_ROW) == 0)
+    {
+        flashEraseRow(address(nextSlot));
+    }
+    flashWrite(address(nextSlot), (const uint8_t *) &(queue[queueStart]), sizeof(queue[0]));
+
+    nextSlot++;
+    if (nextSlot >= HISTORY_NUM_RECORDS)
+    {
+        nextSlot = 0;
+    }
+    queueStart++;
+    if (queueStart >= HISTORY_QUEUE_LEN)
+    {
+        queueStart = 0;
+    }
+    queueCount--;
+}
+
+/* Count the records wanted and get ready to send them */
+uint16_t historyStart(uint16_t fromSequence)
+{
+    HISTORY_RECORD record;
+    uint8_t slot;
+    uint8_t x;
+
+    streamLeft = 0;
+    for (slot = 0; slot < HISTORY_NUM_RECORDS; slot++)
+    {
+        if (readRecord(slot, &record) && ((int16_t) (record.sequence - fromSequence) >= 0))
+        {
+            streamLeft++;
+        }
+    }
+    /* The queued records will be in flash by the time the
+     * read-out starts, perhaps over some of the oldest, in
+     * which case fewer come than were counted */
+    for (x = 0; x < queueCount; x++)
+    {
+        slot = queueStart + x;
+        if (slot >= HISTORY_QUEUE_LEN)
+        {
+            slot -= HISTORY_QUEUE_LEN;
+        }
+        if ((int16_t) (queue[slot].sequence - fromSequence) >= 0)
+        {
+            streamLeft++;
+        }
+    }
+    if (streamLeft > HISTORY_NUM_RECORDS)
+    {
+        streamLeft = HISTORY_NUM_RECORDS;
+    }
+    streamFrom = fromSequence;
+    streamTag = 0;
+    streamPending = true;
+
+    return streamLeft;
+}
+
+/* Whether a read-out is waiting */
+bool historyPending(void)
+{
+    return streamPending;
+}
+
+/* Start a waiting read-out, once the queue is in flash */
+bool historyService(void)
+{
+    if (!streamPending || (queueCount > 0))
+    {
+        return false;
+    }
+
+    /* The oldest record is the one after the newest */
+    streamSlot = nextSlot;
+    streamSlotsLeft = HISTORY_NUM_RECORDS;
+    streamActive = true;
+    if (!streamUSBUSART(produce))
+    {
+        streamActive = false;
+        return false;
+    }
+    streamPending = false;
+
+    return true;
+}
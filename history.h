@@ -0,0 +1,97 @@
+/*
+ * File:   history.h
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 22:30
+ */
+
+#ifndef HISTORY_H
+#define	HISTORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* The history is a circular log of what the unit has done,
+ * kept in flash so that it survives resets.  Records are
+ * appended to the rows in turn, each row being erased only
+ * when the log comes back round to it, so every row wears
+ * at the same rate.  A watering cycle adds three records and
+ * a full pass of the log (HISTORY_NUM_RECORDS) erases each
+ * row once.  test/test_history.c simulates a year of it,
+ * with a reset a month: at the default of a watering every
+ * three days that is 12 erases a row and even at ten
+ * waterings a day it is about 340, against the 10,000 erase
+ * endurance of ordinary flash.
+ *
+ * Each record carries a sequence number and a check byte; a
+ * record or row half written, or half erased, when the
+ * power went is ignored and the log carries on from the
+ * newest good record.
+ *
+ * Records are added to a queue in RAM and written to flash
+ * by historyCommit(), so that the flash stalls fall where
+ * they do no harm; a reset loses whatever is still in the
+ * queue */
+
+/********************************************************
+ * MACROS
+ *******************************************************/
+
+#define HISTORY_NUM_ROWS     8
+// Records waiting to be written: enough for the reset and a
+// whole watering cycle
+#define HISTORY_QUEUE_LEN    4
+
+/********************************************************
+ * TYPES
+ *******************************************************/
+
+/* The things recorded, with what goes in the argument */
+typedef enum
+{
+    HISTORY_TYPE_RESET,            // PCON at reset
+    HISTORY_TYPE_CYCLE_START,      // 0
+    HISTORY_TYPE_SWITCH_CLOSED,    // Motor run time in 10 ms units
+    HISTORY_TYPE_SWITCH_TIMEOUT,   // 0
+    HISTORY_TYPE_SWITCH_RELEASED,  // 0
+    MAX_NUM_HISTORY_TYPES
+} HISTORY_TYPE;
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Find where the log got to; call once at boot */
+void historyInit(void);
+
+/* Add a record to the queue; periods is the time since
+ * reset in watchdog periods.  Only if the queue is full
+ * does this write to flash, see historyCommit() */
+void historyAdd(HISTORY_TYPE type, uint8_t arg, uint32_t periods);
+
+/* Return true if there are records in the queue */
+bool historyQueued(void);
+
+/* Write the oldest record in the queue, if there is one, to
+ * flash.  Stalls the CPU for around 2 ms, 4 ms when a row
+ * has to be erased, so call when there is nothing else to
+ * do */
+void historyCommit(void);
+
+/* Get ready to send the records from sequence number
+ * fromSequence on, returning how many there are, including
+ * any in the queue; they go when historyService() is next
+ * called with the CDC transmit path free and the queue
+ * empty */
+uint16_t historyStart(uint16_t fromSequence);
+
+/* Return true if a read-out is waiting to go */
+bool historyPending(void);
+
+/* Start sending a waiting read-out, see protocol.h, as a CDC
+ * stream on the data port, returning true if it started; it
+ * waits for the queue to be committed.  Call when
+ * reserveUSBUSART() says the transmit path is free */
+bool historyService(void);
+
+#endif	/* HISTORY_H */
@@ -0,0 +1,212 @@
+/*
+ * File:   log.c
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 14:40
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "usb\usb_device.h"
+#include "usb\usb_device_cdc.h"
+#include "log.h"
+
+/********************************************************
+ * MACROS
+ *******************************************************/
+
+// Output is collected in a chunk this big before being
+// written to the transmit ring
+#define LOG_CHUNK_SIZE 16
+
+/********************************************************
+ * PRIVATE VARIABLES
+ *******************************************************/
+
+static uint8_t chunk[LOG_CHUNK_SIZE];
+static uint8_t chunkLength = 0;
+static const char hexDigitsLower[] = "0123456789abcdef";
+static const char hexDigitsUpper[] = "0123456789ABCDEF";
+
+/********************************************************
+ * STATIC FUNCTION PROTOTYPES
+ *******************************************************/
+
+static void flush(void);
+static void putChar(char c);
+static void putUnsigned(uint32_t value, uint8_t base, bool upper, uint8_t width, char pad);
+
+/********************************************************
+ * STATIC FUNCTIONS
+ *******************************************************/
+
+/* Write the collected chunk to the transmit ring */
+static void flush(void)
+{
+    if (chunkLength > 0)
+    {
+        writeUSBUSART(chunk, chunkLength);
+        chunkLength = 0;
+    }
+}
+
+/* Add a character to the chunk */
+static void putChar(char c)
+{
+    chunk[chunkLength] = c;
+    chunkLength++;
+    if (chunkLength >= sizeof(chunk))
+    {
+        flush();
+    }
+}
+
+/* Output an unsigned value in base 10 or 16, padded to at
+ * least width characters */
+static void putUnsigned(uint32_t value, uint8_t base, bool upper, uint8_t width, char pad)
+{
+    char digits[10];
+    uint8_t x = 0;
+    const char *pDigits = hexDigitsLower;
+
+    if (upper)
+    {
+        pDigits = hexDigitsUpper;
+    }
+
+    /* Digits come out least significant first */
+    do
+    {
+        digits[x] = pDigits[value % base];
+        value /= base;
+        x++;
+    } while (value != 0);
+
+    for (; width > x; width--)
+    {
+        putChar(pad);
+    }
+    while (x > 0)
+    {
+        x--;
+        putChar(digits[x]);
+    }
+}
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Write a formatted string to the USB CDC transmit ring */
+void logPrintf(const char *pFormat, ...)
+{
+    va_list args;
+    const char *pString;
+    uint32_t value;
+    bool isLong;
+    uint8_t width;
+    char pad;
+
+    /* Don't even format it if nobody is listening */
+    if (!USBUSARTIsTerminalOpen())
+    {
+        return;
+    }
+
+    va_start(args, pFormat);
+    while (*pFormat != 0)
+    {
+        if (*pFormat != '%')
+        {
+            putChar(*pFormat);
+            pFormat++;
+            continue;
+        }
+        pFormat++;
+
+        /* Flag, width and modifier */
+        pad = ' ';
+        if (*pFormat == '0')
+        {
+            pad = '0';
+            pFormat++;
+        }
+        width = 0;
+        if ((*pFormat >= '1') && (*pFormat <= '9'))
+        {
+            width = *pFormat - '0';
+            pFormat++;
+        }
+        isLong = false;
+        if (*pFormat == 'l')
+        {
+            isLong = true;
+            pFormat++;
+        }
+
+        switch (*pFormat)
+        {
+            case 'c':
+                putChar((char) va_arg(args, int));
+            break;
+            case 's':
+                pString = va_arg(args, const char *);
+                while (*pString != 0)
+                {
+                    putChar(*pString);
+                    pString++;
+                }
+            break;
+            case 'd':
+                if (isLong)
+                {
+                    value = (uint32_t) va_arg(args, int32_t);
+                }
+                else
+                {
+                    value = (uint32_t) (int32_t) va_arg(args, int);
+                }
+                if ((int32_t) value < 0)
+                {
+                    putChar('-');
+                    value = -value;
+                }
+                putUnsigned(value, 10, false, width, pad);
+            break;
+            case 'u':
+            case 'x':
+            case 'X':
+                if (isLong)
+                {
+                    value = va_arg(args, uint32_t);
+                }
+                else
+                {
+                    value = va_arg(args, unsigned int);
+                }
+                if (*pFormat == 'u')
+                {
+                    putUnsigned(value, 10, false, width, pad);
+                }
+                else
+                {
+                    putUnsigned(value, 16, (*pFormat == 'X'), width, pad);
+                }
+            break;
+            case '%':
+                putChar('%');
+            break;
+            case 0:
+                /* Format ends in the middle of a conversion */
+                pFormat--;
+            break;
+            default:
+            break;
+        }
+        pFormat++;
+    }
+    va_end(args);
+
+    flush();
+}
@@ -0,0 +1,25 @@
+/*
+ * File:   log.h
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 14:40
+ */
+
+#ifndef LOG_H
+#define	LOG_H
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Write a formatted string to the USB CDC transmit ring.
+ * Only a subset of printf() is supported, to keep the code
+ * small: %c, %s, %d, %u, %x and %X, with an optional l
+ * (32 bit) modifier, an optional 0 flag and a single digit
+ * field width (e.g. %04x), plus %%.  Output is dropped (and
+ * counted by USBUSARTTxOverflowCount()) if the ring is full,
+ * and isn't generated at all unless a terminal has the port
+ * open (see USBUSARTIsTerminalOpen()) */
+void logPrintf(const char *pFormat, ...);
+
+#endif	/* LOG_H */
@@ -8,13 +8,32 @@
 #include <xc.h>
 #include "usb\usb_device.h"
 #include "usb\usb_device_cdc.h"
+#include "events.h"
+#include "log.h"
+#include "protocol.h"
+#include "command.h"
+#include "telemetry.h"
+#include "config.h"
+#include "history.h"
+#include "dfu.h"
+#include "serial.h"
 
 /********************************************************
  * MACROS
  *******************************************************/
 
-// 3 days at a watchdog timer of 256 seconds
+// The defaults for what's kept in flash, see config.h, used
+// until the host sets something else
+
+// 3 days at a watchdog timer of 256 seconds, the default
+// time between waterings
 #define WATCHDOG_COUNT_MAX    1000
+// The default time the motor runs for, unless the switch
+// moves first
+#define MOTOR_ON_MS           150
+// The watchdog period in milliseconds, for when we have to stay
+// awake to service USB instead of sleeping
+#define WATCHDOG_PERIOD_MS    256000UL
 
 #define MOTOR_PIN_LAT         LATAbits.LATA5 
 #define SWITCH_PIN_LAT        LATAbits.LATA4 
@@ -31,19 +50,95 @@
 
 #define DEBOUNCE_PERIOD_MS    100
 
+// PCON with all of the reset flags re-armed, so that the
+// next reset shows up in them
+#define PCON_REARM            0x1F
+
+// Timer1 counts instruction cycles, at Fosc/4 with no prescaler,
+// to time loading the configuration at boot if SYSTEM_Initialize()
+// hasn't already started it that way
+#define TIMER1_T1CON_FOSC_4   0x01
+
+// The scheduler tick, which is also how often the USB stack is
+// polled when it is idle in hybrid polling mode (max 16 ms)
+#if defined(USB_HYBRID_POLLING)
+# define SCHEDULER_TICK_MS    USB_HYBRID_POLL_PERIOD_MS
+#else
+# define SCHEDULER_TICK_MS    8
+#endif
+
+// Timer2 provides the scheduler tick: Fosc/4 with a 64 prescaler
+// and a PR2 of 187 gives ~1 ms, the postscaler then sets TMR2IF
+// every SCHEDULER_TICK_MS
+#define TIMER2_PR2_1MS        187
+#define TIMER2_T2CON          (((SCHEDULER_TICK_MS - 1) << 3) | 0x04 | 0x03)
+
+// How the watering cycle is reported to the host as SerialState
+// notifications on the CDC comm endpoint: DCD is on while the motor
+// runs, DSR follows the switch, a ring means an event record has
+// been queued and a break means the switch didn't move in time
+#define SERIAL_STATE_MOTOR    CDC_SERIAL_STATE_DCD
+#define SERIAL_STATE_SWITCH   CDC_SERIAL_STATE_DSR
+#define SERIAL_STATE_EVENT    CDC_SERIAL_STATE_RING
+#define SERIAL_STATE_FAULT    CDC_SERIAL_STATE_BREAK
+
+// Output is only generated while a terminal has the port open
+// (DTR asserted).  Define this to send the event records queued
+// while nobody was listening when a terminal opens the port,
+// otherwise they are thrown away
+#define REPLAY_EVENTS_ON_OPEN
+
 /********************************************************
  * PRIVATE VARIABLES
  *******************************************************/
 
-static uint8_t readBuffer[CDC_DATA_OUT_EP_SIZE];
-static uint8_t writeBuffer[CDC_DATA_IN_EP_SIZE];
+/* Milliseconds (approximately) counted by the scheduler tick */
+static uint32_t schedulerMs = 0;
+/* How event records are named when sent to the host */
+static const char *eventNames[MAX_NUM_EVENT_TYPES] = {"WATERING START", "WATERING END"};
+static const char hexDigits[] = "0123456789ABCDEF";
+/* Whether a terminal had the port open last time we looked */
+static bool terminalOpen = false;
+/* The settings, which the host may change, loaded from flash
+ * at boot, with how it went and how long it took */
+static CONFIG config = {WATCHDOG_COUNT_MAX, MOTOR_ON_MS, DEBOUNCE_PERIOD_MS};
+static bool configLoaded = false;
+static uint16_t configLoadCycles = 0;
+/* Watchdog periods spent asleep, for the history */
+static uint32_t sleptPeriods = 0;
+/* Progress towards the next watering and the current one */
+static uint16_t periodsWaited = 0;
+static bool watering = false;
+/* Counted since power on, stopping at the maximum */
+static uint16_t wateringCount = 0;
+static uint16_t faultCount = 0;
+/* A motor test requested by the host */
+static bool motorTestRunning = false;
+static uint32_t motorTestStartMs;
+static uint16_t motorTestMs;
 
 /********************************************************
  * STATIC FUNCTION PROTOTYPES
  *******************************************************/
 
+static bool usbActive(void);
+static uint32_t uptimePeriods(void);
+static void commitFlash(void);
+static void commitFlashAll(void);
+#if defined(USB_DFU_RUNTIME)
+static void detachToBootloader(void);
+#endif
+static bool sleepUntilWoken(void);
+static void schedulerTick(void);
+static void motorTestStop(void);
+static void usbService(void);
 static void waitMs(uint32_t milliseconds);
 static void waitMsForSwitch(uint32_t milliseconds);
+static void waitWatchdogPeriod(void);
+static void waitForSwitch(void);
+static void notifyEvent(EVENT_TYPE type);
+static uint8_t appendString(uint8_t *pBuffer, uint8_t x, const char *pString);
+static bool sendEvent(uint8_t *pBuffer);
 static void appInit();
 static void appMain(void);
 
@@ -51,6 +146,150 @@ static void appMain(void);
  * STATIC FUNCTIONS
  *******************************************************/
 
+/* Return true if the USB bus is in use and so we must stay awake
+ * to service it.  With no host attached the bus is idle and
+ * the USB module goes into suspend, just as it does when a host
+ * suspends it, and in both cases bus activity will wake us */
+static bool usbActive(void)
+{
+    return (USBGetDeviceState() != DETACHED_STATE) && !USBIsDeviceSuspended();
+}
+
+/* Roughly how long it is since reset, in watchdog periods:
+ * the time asleep plus the time awake, which is only as good
+ * as the scheduler tick and loses a partial period whenever
+ * something wakes us early */
+static uint32_t uptimePeriods(void)
+{
+    return sleptPeriods + schedulerMs / WATCHDOG_PERIOD_MS;
+}
+
+/* Do one of the flash writes that have been put off, see
+ * config.h and history.h, configuration first since the host
+ * may be waiting on it; each stalls the CPU for a few ms, so
+ * only call this when there is nothing else to do, i.e. not
+ * while the motor is running or a debounce is being timed */
+static void commitFlash(void)
+{
+    if (configPending())
+    {
+        configCommit();
+    }
+    else
+    {
+        historyCommit();
+    }
+}
+
+/* Do all of the flash writes that have been put off; a
+ * configuration record that won't read back is tried again
+ * next time rather than holding us here */
+static void commitFlashAll(void)
+{
+    configCommit();
+    while (historyQueued())
+    {
+        historyCommit();
+    }
+}
+
+#if defined(USB_DFU_RUNTIME)
+/* Leave for the bootloader, see dfu.h, with the motor off and
+ * nothing left unwritten */
+static void detachToBootloader(void)
+{
+    MOTOR_PIN_LAT = 0;
+    commitFlashAll();
+    USBDeviceDetach();
+    RESET();
+}
+#endif
+
+/* Sleep until the watchdog or an interrupt wakes us, having
+ * first written anything waiting to go to flash; return true
+ * if it was the watchdog, i.e. a whole period went by */
+static bool sleepUntilWoken(void)
+{
+    bool timedOut = false;
+
+    commitFlashAll();
+    WDTCONbits.SWDTEN = 1;
+    SLEEP();
+    NOP();
+    WDTCONbits.SWDTEN = 0;
+    if (!STATUSbits.nTO)
+    {
+        sleptPeriods++;
+        timedOut = true;
+    }
+
+    return timedOut;
+}
+
+/* The scheduler tick: keep time and, if we're in the polled
+ * phase of hybrid USB operation, give the USB stack a look-in.
+ * Must be called at least every SCHEDULER_TICK_MS */
+static void schedulerTick(void)
+{
+    if (PIR1bits.TMR2IF)
+    {
+        PIR1bits.TMR2IF = 0;
+        schedulerMs += SCHEDULER_TICK_MS;
+        if (motorTestRunning && (schedulerMs - motorTestStartMs >= motorTestMs))
+        {
+            motorTestStop();
+        }
+#if defined(USB_HYBRID_POLLING)
+        USBHybridPoll();
+#endif
+        /* Vendor requests are answered promptly wherever we are,
+         * e.g. in the middle of a watering cycle, once any change
+         * they made is in flash; the commit stalls the CPU, so
+         * not while it would lengthen a watering */
+        if (commandVendorCommitting() && !MOTOR_PIN_LAT)
+        {
+            configCommit();
+        }
+        commandVendorService();
+#if defined(USB_DFU_RUNTIME)
+        /* As is a DFU client asking us to detach */
+        if (dfuService(schedulerMs))
+        {
+            detachToBootloader();
+        }
+#endif
+#if !defined(USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS)
+        /* Keep logging output moving, even in the middle of
+         * a watering cycle */
+        if ((USBGetDeviceState() >= CONFIGURED_STATE) && !USBIsDeviceSuspended())
+        {
+            CDCTxService();
+        }
+#endif
+    }
+}
+
+/* End a motor test */
+static void motorTestStop(void)
+{
+    MOTOR_PIN_LAT = 0;
+    CDCSetSerialState(SERIAL_STATE_MOTOR, 0);
+    motorTestRunning = false;
+}
+
+/* Run the scheduler tick and, if the USB device is configured
+ * and not suspended, do application stuff, then use the time
+ * that's left for a flash write */
+static void usbService(void)
+{
+    schedulerTick();
+    if ((USBGetDeviceState() >= CONFIGURED_STATE) && !USBIsDeviceSuspended())
+    {
+        appMain();
+    }
+    commitFlash();
+}
+
 /* Wait for a number of milliseconds */
 static void waitMs(uint32_t milliseconds)
 {
@@ -63,7 +302,10 @@ static void waitMs(uint32_t milliseconds)
     {
         TMR0bits.TMR0 = 0;
         INTCONbits.TMR0IF = 0;
-        while (!INTCONbits.TMR0IF) {};
+        while (!INTCONbits.TMR0IF)
+        {
+            schedulerTick();
+        }
         INTCONbits.TMR0IF = 0;
     }
 }
@@ -84,7 +326,10 @@ static void waitMsForSwitch(uint32_t milliseconds)
     {
         TMR0bits.TMR0 = 0;
         INTCONbits.TMR0IF = 0;
-        while (!INTCONbits.TMR0IF) {};
+        while (!INTCONbits.TMR0IF)
+        {
+            schedulerTick();
+        }
         INTCONbits.TMR0IF = 0;
     }
     
@@ -92,6 +337,118 @@ static void waitMsForSwitch(uint32_t milliseconds)
     INTCONbits.IOCIE = 0;   
 }
 
+/* Wait for a watchdog period: sleep if we can, otherwise stay
+ * awake for the equivalent time (approximately) servicing USB.
+ * The host suspending or resuming the bus moves us from one to
+ * the other part way through, so keep going until a whole period
+ * has passed: the time counted by the scheduler while awake or a
+ * watchdog timeout while asleep, not just any wake */
+static void waitWatchdogPeriod(void)
+{
+    uint32_t awakeMs = 0;
+    uint32_t start;
+    bool done = false;
+
+    while (!done)
+    {
+        if (usbActive())
+        {
+            start = schedulerMs;
+            while (usbActive() && (awakeMs + (schedulerMs - start) < WATCHDOG_PERIOD_MS))
+            {
+                usbService();
+            }
+            awakeMs += schedulerMs - start;
+            done = (awakeMs >= WATCHDOG_PERIOD_MS);
+        }
+        else
+        {
+            /* Nothing will be keeping time while we're asleep */
+            if (motorTestRunning)
+            {
+                motorTestStop();
+            }
+            done = sleepUntilWoken();
+        }
+    }
+}
+
+/* Wait until the switch interrupt goes off, sleeping if USB
+ * allows, otherwise servicing USB */
+static void waitForSwitch(void)
+{
+    /* Clear the switch interrupt flag and enable the interrupt */
+    SWITCH_PIN_INT_FLAG = 0;
+    INTCONbits.IOCIE = 1;
+    while (!SWITCH_PIN_INT_FLAG)
+    {
+        if (usbActive())
+        {
+            usbService();
+        }
+        else
+        {
+            /* Go to sleep until interrupted; USB activity may also
+             * wake us, hence the loop.  The watchdog is a backstop
+             * in case the switch went off just before the SLEEP */
+            sleepUntilWoken();
+        }
+    }
+    /* Disable the interrupt */
+    INTCONbits.IOCIE = 0;
+}
+
+/* Record an event and, if the host has suspended the bus and
+ * allowed us to, wake it up so that it hears about the event now */
+static void notifyEvent(EVENT_TYPE type)
+{
+    eventsPush(type);
+    CDCSetSerialState(SERIAL_STATE_EVENT, SERIAL_STATE_EVENT);
+    USBCBSendResume();
+}
+
+/* Append a string to an endpoint-sized buffer at position x,
+ * returning the new position */
+static uint8_t appendString(uint8_t *pBuffer, uint8_t x, const char *pString)
+{
+    while ((*pString != 0) && (x < CDC_DATA_IN_EP_SIZE))
+    {
+        pBuffer[x] = *pString;
+        pString++;
+        x++;
+    }
+
+    return x;
+}
+
+/* If there is an event record queued, write it into pBuffer, the
+ * reserved CDC transmit buffer, as a line of text, e.g.
+ * "EVENT 002A WATERING END", where 002A is the sequence number
+ * in hex, send it to the host and return true */
+static bool sendEvent(uint8_t *pBuffer)
+{
+    EVENT_RECORD record;
+    uint8_t x;
+
+    if (!eventsPop(&record))
+    {
+        return false;
+    }
+
+    x = appendString(pBuffer, 0, "EVENT ");
+    for (int8_t shift = 12; shift >= 0; shift -= 4)
+    {
+        pBuffer[x] = hexDigits[(record.sequence >> shift) & 0x0F];
+        x++;
+    }
+    x = appendString(pBuffer, x, " ");
+    x = appendString(pBuffer, x, eventNames[record.type]);
+    x = appendString(pBuffer, x, "\r\n");
+    submitUSBUSART(x);
+
+    return true;
+}
+
 /* Initialise the application code */
 static void appInit()
 {
@@ -101,53 +458,171 @@ static void appInit()
 /* The application entry point */
 static void appMain(void)
 {
-    if (USBUSARTIsTxTrfReady())
+    uint8_t *writeBuffer;
+    uint8_t *pData;
+    uint8_t length;
+
+    /* Commands have a port of their own, so a response never
+     * waits behind the log, telemetry or a history read-out */
+    writeBuffer = reserveCmdUSBUSART();
+    if (writeBuffer != NULL)
     {
-        uint8_t i;
-        uint8_t numBytesRead;
-
-        numBytesRead = getsUSBUSART(readBuffer, sizeof(readBuffer));
-
-        /* For every byte that was read... */
-        for (i = 0; i < numBytesRead; i++)
+        length = commandService(writeBuffer);
+        if (length > 0)
         {
-            switch(readBuffer[i])
-            {
-                /* If we receive new line or line feed commands, just echo
-                 * them direct.
-                 */
-                case 0x0A:
-                case 0x0D:
-                    writeBuffer[i] = readBuffer[i];
-                break;
-
-                /* If we receive something else, then echo it plus one
-                 * so that if we receive 'a', we echo 'b' so that the
-                 * user knows that it isn't the echo enabled on their
-                 * terminal program.
-                 */
-                default:
-                    writeBuffer[i] = readBuffer[i] + 1;
-                break;
-            }
+            submitCmdUSBUSART(length);
         }
+    }
+
+    /* Nothing is read from the data port, anything sent to it
+     * is thrown away */
+    if (peekUSBUSART(&pData) > 0)
+    {
+        commitUSBUSART();
+    }
 
-        if (numBytesRead > 0)
+    /* Nothing is generated unless a terminal is listening; when
+     * one opens the port it gets the events it missed, if wanted */
+    writeBuffer = NULL;
+    if (USBUSARTIsTerminalOpen())
+    {
+        if (!terminalOpen)
         {
-            /* After processing all of the received data, we need to send out
-             * the "echo" data now.
-             */
-            putUSBUSART(writeBuffer, numBytesRead);
+#if !defined(REPLAY_EVENTS_ON_OPEN)
+            eventsFlush();
+#endif
+            terminalOpen = true;
+            logPrintf("Config %s, loaded in %u cycles\r\n",
+                      configLoaded ? "from flash" : "defaults", configLoadCycles);
         }
+
+        /* Output is written straight into the CDC transmit buffer,
+         * if it's free.  Queued event records go first, e.g. just after
+         * the host has resumed the bus because we woke it up */
+        writeBuffer = reserveUSBUSART();
+    }
+    else
+    {
+        terminalOpen = false;
+    }
+
+    /* Telemetry collects in the transmit buffer while nothing
+     * else needs it; anything else that comes along sends it */
+    if ((writeBuffer != NULL) && (USBUSARTTxHeld() > 0) &&
+        (eventsPending() || historyPending()))
+    {
+        submitUSBUSART(USBUSARTTxHeld());
+        writeBuffer = NULL;
+    }
+
+    /* A history read-out follows, on the data port, the
+     * response that asked for it */
+    if ((writeBuffer != NULL) && historyService())
+    {
+        writeBuffer = NULL;
+    }
+
+    /* With no event to send, add to the telemetry, which is
+     * bounded by PROTOCOL_TELEMETRY_MS_MIN and isn't taken
+     * while watering */
+    if ((writeBuffer != NULL) && !sendEvent(writeBuffer))
+    {
+        telemetryService(writeBuffer, schedulerMs);
+    }
+
+    /* The log waits while the buffer is reserved, so give it
+     * back if nothing above sent or held it */
+    if (writeBuffer != NULL)
+    {
+        releaseUSBUSART();
     }
     
+#if !defined(USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS)
     CDCTxService();
+#endif
 }
 
 /********************************************************
  * PUBLIC FUNCTIONS
  *******************************************************/
 
+/* Return the PROTOCOL_FLAG_xxx bits that apply now and the
+ * number of watchdog periods until the next watering */
+uint8_t appGetStatus(uint16_t *pPeriodsRemaining)
+{
+    uint8_t flags = 0;
+
+    if (MOTOR_PIN_LAT)
+    {
+        flags |= PROTOCOL_FLAG_MOTOR_ON;
+    }
+    /* The switch pulls the pin low against the pull-up */
+    if (!SWITCH_PIN_PORT)
+    {
+        flags |= PROTOCOL_FLAG_SWITCH_CLOSED;
+    }
+    if (watering)
+    {
+        flags |= PROTOCOL_FLAG_WATERING;
+    }
+    if (motorTestRunning)
+    {
+        flags |= PROTOCOL_FLAG_MOTOR_TEST;
+    }
+
+    *pPeriodsRemaining = 0;
+    if (!watering && (periodsWaited < config.wateringPeriods))
+    {
+        *pPeriodsRemaining = config.wateringPeriods - periodsWaited;
+    }
+
+    return flags;
+}
+
+/* Get the watering schedule */
+void appGetSchedule(uint16_t *pPeriods, uint16_t *pMotorMs)
+{
+    *pPeriods = config.wateringPeriods;
+    *pMotorMs = config.motorMs;
+}
+
+/* Set the watering schedule, from the next watering, and
+ * keep it in flash, once there is time, if it has changed */
+void appSetSchedule(uint16_t periods, uint16_t milliseconds)
+{
+    if ((periods != config.wateringPeriods) || (milliseconds != config.motorMs))
+    {
+        config.wateringPeriods = periods;
+        config.motorMs = milliseconds;
+        configSave(&config);
+    }
+}
+
+/* Get the application's counters */
+void appGetCounters(uint16_t *pWaterings, uint16_t *pFaults)
+{
+    *pWaterings = wateringCount;
+    *pFaults = faultCount;
+}
+
+/* Run the motor for a while, unless we're in the middle of
+ * watering or a test already */
+bool appMotorTest(uint16_t milliseconds)
+{
+    if (watering || motorTestRunning)
+    {
+        return false;
+    }
+
+    motorTestStartMs = schedulerMs;
+    motorTestMs = milliseconds;
+    motorTestRunning = true;
+    CDCSetSerialState(SERIAL_STATE_MOTOR, SERIAL_STATE_MOTOR);
+    MOTOR_PIN_LAT = 1;
+
+    return true;
+}
+
 /* This function is called from the USB stack to notify a user application
  * that a USB event occurred.  This callback is in interrupt context
  * when USB_INTERRUPT is defined. */
@@ -159,6 +634,8 @@ bool USER_USB_CALLBACK_EVENT_HANDLER(USB_EVENT event, void *pdata, uint16_t size
         break;
 
         case EVENT_SOF:
+            /* Lets the CDC driver time out coalesced writes */
+            USBCDCEventHandler(event, pdata, size);
         break;
 
         case EVENT_SUSPEND:
@@ -194,12 +671,22 @@ bool USER_USB_CALLBACK_EVENT_HANDLER(USB_EVENT event, void *pdata, uint16_t size
             /* We have received a non-standard USB request.  The HID driver
              * needs to check to see if the request was for it. */
             USBCheckCDCRequest();
+            /* Let the host read our USB statistics */
+            USBCheckStatisticsRequest();
+            /* Let the host run commands without opening the port */
+            commandCheckVendorRequest();
+#if defined(USB_DFU_RUNTIME)
+            /* Let a DFU client detach us for a firmware update */
+            dfuCheckRequest();
+#endif
         break;
 
         case EVENT_BUS_ERROR:
+            /* Counted by the stack, see USBGetStatistics() */
         break;
 
         case EVENT_TRANSFER_TERMINATED:
+            USBCDCEventHandler(event, pdata, size);
         break;
 
         default:
@@ -212,6 +699,11 @@ bool USER_USB_CALLBACK_EVENT_HANDLER(USB_EVENT event, void *pdata, uint16_t size
 /* Main */
 void main(void)
 {
+    uint32_t motorStartMs;
+    uint32_t motorRunMs;
+    uint8_t t1con;
+    uint16_t start;
+
     /* Make sure RA4/RA5 are used for digital */
     ANSELAbits.ANSELA = 0;
     
@@ -252,52 +744,96 @@ void main(void)
     /* Set up clocks */
     SYSTEM_Initialize(SYSTEM_STATE_USB_START);
 
+    /* Load the settings, timing it from the difference between
+     * two Timer1 readings: Timer1 may already be running for
+     * the USB load measurement and is left as it was found */
+    t1con = T1CON;
+    if (!T1CONbits.TMR1ON)
+    {
+        T1CON = TIMER1_T1CON_FOSC_4;
+    }
+    start = SYSTEM_ReadTimer1();
+    configLoaded = configLoad(&config);
+    configLoadCycles = SYSTEM_ReadTimer1() - start;
+    T1CON = t1con;
+
+    /* Pick up the history where it left off and note the reset */
+    historyInit();
+    historyAdd(HISTORY_TYPE_RESET, PCON, 0);
+    PCON = PCON_REARM;
+
+    /* The host reads the serial number as soon as we attach */
+    serialInit();
+
+    /* Start the scheduler tick */
+    PR2 = TIMER2_PR2_1MS;
+    T2CON = TIMER2_T2CON;
+
+    /* Bring up USB; if there's no host the bus will be idle and
+     * the USB module will suspend, letting us sleep */
+    USBDeviceInit();
+    USBDeviceAttach();
+
     while (1)
     {
-        /* Wait for the right number of watchdog expirations */
-        for (uint32_t x = 0; x < WATCHDOG_COUNT_MAX; x++)
+        /* Wait for the right number of watchdog periods */
+        for (periodsWaited = 0; periodsWaited < config.wateringPeriods; periodsWaited++)
         {
-            WDTCONbits.SWDTEN = 1;
-            SLEEP();
-            NOP();
-            WDTCONbits.SWDTEN = 0;
+            waitWatchdogPeriod();
         }
 
-        /* Switch on the motor for 150 ms or until the switch GPIO goes off */
+        /* Switch on the motor for config.motorMs or until the switch GPIO goes
+         * off, taking over from any motor test.  The host is told first:
+         * waking it can take ~16 ms with the USB interrupt masked, which
+         * must not come out of the time the motor runs for or hide the
+         * switch moving */
+        historyAdd(HISTORY_TYPE_CYCLE_START, 0, uptimePeriods());
+        watering = true;
+        if (motorTestRunning)
+        {
+            motorTestStop();
+        }
+        CDCSetSerialState(SERIAL_STATE_MOTOR, SERIAL_STATE_MOTOR);
+        notifyEvent(EVENT_TYPE_WATERING_START);
+        logPrintf("Motor on\r\n");
+        motorStartMs = schedulerMs;
         MOTOR_PIN_LAT = 1;
-        waitMsForSwitch(150);
+        waitMsForSwitch(config.motorMs);
         MOTOR_PIN_LAT = 0;
+        if (SWITCH_PIN_INT_FLAG)
+        {
+            CDCSetSerialState(SERIAL_STATE_MOTOR | SERIAL_STATE_SWITCH, SERIAL_STATE_SWITCH);
+            motorRunMs = schedulerMs - motorStartMs;
+            historyAdd(HISTORY_TYPE_SWITCH_CLOSED, motorRunMs < 2550 ? motorRunMs / 10 : 255, uptimePeriods());
+        }
+        else
+        {
+            CDCSetSerialState(SERIAL_STATE_MOTOR | SERIAL_STATE_FAULT, SERIAL_STATE_FAULT);
+            historyAdd(HISTORY_TYPE_SWITCH_TIMEOUT, 0, uptimePeriods());
+            if (faultCount < 0xFFFF)
+            {
+                faultCount++;
+            }
+        }
+        logPrintf("Motor off, switch %s\r\n", SWITCH_PIN_INT_FLAG ? "moved" : "timed out");
         /* Debounce the switch, which should have been pressed by now */
-        waitMs(DEBOUNCE_PERIOD_MS);
+        waitMs(config.debounceMs);
         
         /* If we get here the switch should have been closed by the motor rotation.
          * The next thing that matters is the interrupt going off when
          * the switch is released after I've watered the plants, which will take
          * us around the loop again */
-        /* Clear the switch interrupt flag and enable the interrupt */
-        SWITCH_PIN_INT_FLAG = 0;
-        INTCONbits.IOCIE = 1;
-        /* Go to sleep until interrupted */
-        SLEEP();
-        NOP();
-        /* Disable the interrupt and debounce */
-        INTCONbits.IOCIE = 0;   
-        waitMs(DEBOUNCE_PERIOD_MS);
-    }
-    
-    /* We don't actually need USB at all, this just kept
-     * in the code in case I need to send printf()s for debug at some point */
-    
-    USBDeviceInit();
-    USBDeviceAttach();
-    
-    while (1)
-    {
-        /* If the USB device is configured and not suspended then do
-         * application stuff */
-        if ((USBGetDeviceState() >= CONFIGURED_STATE) && !USBIsDeviceSuspended())
+        waitForSwitch();
+        /* Debounce */
+        waitMs(config.debounceMs);
+        CDCSetSerialState(SERIAL_STATE_SWITCH, 0);
+        historyAdd(HISTORY_TYPE_SWITCH_RELEASED, 0, uptimePeriods());
+        watering = false;
+        if (wateringCount < 0xFFFF)
         {
-            appMain();
+            wateringCount++;
         }
+        notifyEvent(EVENT_TYPE_WATERING_END);
+        logPrintf("Watering done, %u log bytes lost\r\n", USBUSARTTxOverflowCount());
     }
 }
\ No newline at end of file
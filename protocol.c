@@ -0,0 +1,62 @@
+/*
+ * File:   protocol.c
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 16:05
+ */
+
+#include <stdint.h>
+#include "protocol.h"
+
+/********************************************************
+ * MACROS
+ *******************************************************/
+
+// The CRC-16/CCITT polynomial; the CRC is done bit by bit
+// since a table would cost 512 bytes of program memory
+#define CRC16_POLYNOMIAL 0x1021
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Add length bytes to a CRC-16/CCITT-FALSE */
+uint16_t protocolCrc16(uint16_t crc, const uint8_t *pData, uint8_t length)
+{
+    uint8_t bit;
+
+    while (length > 0)
+    {
+        crc ^= (uint16_t) *pData << 8;
+        for (bit = 0; bit < 8; bit++)
+        {
+            if (crc & 0x8000)
+            {
+                crc = (crc << 1) ^ CRC16_POLYNOMIAL;
+            }
+            else
+            {
+                crc <<= 1;
+            }
+        }
+        pData++;
+        length--;
+    }
+
+    return crc;
+}
+
+/* Complete a frame whose payload is already in place */
+uint8_t protocolFrameEnd(uint8_t *pFrame, uint8_t tag, uint8_t command, uint8_t length)
+{
+    uint16_t crc;
+
+    pFrame[0] = PROTOCOL_SYNC;
+    pFrame[PROTOCOL_OFFSET_LEN] = length + 2;
+    pFrame[PROTOCOL_OFFSET_TAG] = tag;
+    pFrame[PROTOCOL_OFFSET_CMD] = command;
+    crc = protocolCrc16(0xFFFF, pFrame + PROTOCOL_OFFSET_LEN, length + 3);
+    PROTOCOL_PUT_UINT16(pFrame + PROTOCOL_OFFSET_PAYLOAD + length, crc);
+
+    return length + PROTOCOL_OVERHEAD;
+}
@@ -0,0 +1,216 @@
+/*
+ * File:   protocol.h
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 16:05
+ */
+
+#ifndef PROTOCOL_H
+#define	PROTOCOL_H
+
+/* The binary command protocol.  The unit is a composite of
+ * two CDC ACM ports: requests and their responses go over the
+ * second, the command port, while telemetry and history
+ * frames come unasked over the first, the data port, among
+ * the ASCII log and event text, once a terminal has it open.
+ * This file is plain C with no dependency on the PIC or the
+ * USB stack so that host-side code can include it as-is.
+ *
+ * Each frame, in either direction, is:
+ *
+ *   SYNC  LEN  TAG  CMD  payload...  CRC_LO  CRC_HI
+ *
+ * SYNC is PROTOCOL_SYNC, which never appears in the ASCII
+ * log and event text sharing the data port, so a receiver skips
+ * anything else while looking for it.  LEN is the number of
+ * bytes from TAG to the end of the payload (2 to
+ * PROTOCOL_LEN_MAX) and the CRC is CRC-16/CCITT-FALSE over
+ * LEN, TAG, CMD and the payload.  Multi-byte values in
+ * payloads are little-endian.
+ *
+ * TAG is chosen by the host and is returned in the response,
+ * so a host may send up to PROTOCOL_MAX_IN_FLIGHT requests
+ * before it reads any responses, e.g. a batch in one write,
+ * and match the responses up as they come.  Requests
+ * are handled in the order they arrive and their responses
+ * come back in the same order, several to a USB packet where
+ * they fit.  A request frame may be no more than
+ * PROTOCOL_REQUEST_FRAME_MAX bytes long.
+ *
+ * A response has PROTOCOL_RESPONSE set in CMD and its
+ * payload starts with a PROTOCOL_STATUS_xxx byte; the data
+ * listed against each command below only follows if that
+ * is PROTOCOL_STATUS_OK.  Frames with a bad CRC or LEN are
+ * dropped without a response, which is how the host knows
+ * to resend: a response that is skipped over in the order
+ * will not come.
+ *
+ * The same commands may also be sent, without opening the
+ * command port, as vendor requests on the control endpoint:
+ * bmRequestType 0xC0 (device to host, vendor, device),
+ * bRequest PROTOCOL_VENDOR_REQUEST_BASE plus CMD, the request
+ * payload, at most PROTOCOL_VENDOR_REQUEST_LEN_MAX bytes, in
+ * wValue then wIndex and wLength at least one more than the
+ * length of the response data.  The data stage is the
+ * response payload, status then data, with no SYNC, LEN,
+ * TAG, CMD or CRC.  The data stage waits until any change
+ * to the schedule has been written to flash and read back,
+ * so a request that returns has made it stick; while the
+ * motor runs that can take up to PROTOCOL_MOTOR_MS_MAX, so
+ * allow for it in the host's timeout.  Over the command
+ * port the response comes first and flash follows shortly
+ * after */
+
+#include <stdint.h>
+
+/********************************************************
+ * MACROS
+ *******************************************************/
+
+// Bumped when the protocol changes incompatibly
+#define PROTOCOL_VERSION                  3
+
+#define PROTOCOL_SYNC                     0xA5
+#define PROTOCOL_RESPONSE                 0x80
+
+// A frame, including SYNC, LEN and CRC, always fits in one
+// 64 byte USB packet
+#define PROTOCOL_FRAME_MAX                64
+#define PROTOCOL_OVERHEAD                 6
+#define PROTOCOL_LEN_MAX                  (PROTOCOL_FRAME_MAX - PROTOCOL_OVERHEAD + 2)
+#define PROTOCOL_OFFSET_LEN               1
+#define PROTOCOL_OFFSET_TAG               2
+#define PROTOCOL_OFFSET_CMD               3
+#define PROTOCOL_OFFSET_PAYLOAD           4
+// Where response data starts, after the status byte
+#define PROTOCOL_OFFSET_DATA              5
+#define PROTOCOL_DATA_MAX                 (PROTOCOL_FRAME_MAX - PROTOCOL_OVERHEAD - 1)
+
+// The most requests a host may have outstanding, each no
+// longer than PROTOCOL_REQUEST_FRAME_MAX, which is one USB
+// packet on the command port: those the unit isn't ready
+// for yet wait in its receive ring or, once that is full,
+// are NAKed and wait at the host
+#define PROTOCOL_MAX_IN_FLIGHT            8
+#define PROTOCOL_REQUEST_FRAME_MAX        16
+
+// Vendor request numbers below the base belong to the USB
+// stack, e.g. USB_STATISTICS_VENDOR_REQUEST
+#define PROTOCOL_VENDOR_REQUEST_BASE      0x40
+#define PROTOCOL_VENDOR_REQUEST_LEN_MAX   4
+
+// Status codes, the first byte of every response payload
+#define PROTOCOL_STATUS_OK                0
+#define PROTOCOL_STATUS_UNKNOWN_COMMAND   1
+#define PROTOCOL_STATUS_BAD_LENGTH        2
+#define PROTOCOL_STATUS_BAD_VALUE         3
+#define PROTOCOL_STATUS_BUSY              4
+
+// Read the state of the unit
+// Request: nothing
+// Response: version (1), PROTOCOL_FLAG_xxx (1),
+//           watchdog periods until the next watering (2)
+#define PROTOCOL_CMD_GET_STATUS           0x01
+#define PROTOCOL_GET_STATUS_RSP_LEN       4
+#define PROTOCOL_FLAG_MOTOR_ON            0x01
+#define PROTOCOL_FLAG_SWITCH_CLOSED       0x02
+#define PROTOCOL_FLAG_WATERING            0x04
+#define PROTOCOL_FLAG_MOTOR_TEST          0x08
+
+// Read the watering schedule
+// Request: nothing
+// Response: watchdog periods (of 256 seconds) between
+//           waterings (2), motor run time in ms (2)
+#define PROTOCOL_CMD_GET_SCHEDULE         0x02
+#define PROTOCOL_GET_SCHEDULE_RSP_LEN     4
+
+// Set the watering schedule, which takes effect from
+// the next watering
+// Request: as the GET_SCHEDULE response
+// Response: nothing
+#define PROTOCOL_CMD_SET_SCHEDULE         0x03
+#define PROTOCOL_SET_SCHEDULE_REQ_LEN     4
+#define PROTOCOL_PERIODS_MIN              1
+#define PROTOCOL_MOTOR_MS_MIN             10
+#define PROTOCOL_MOTOR_MS_MAX             2000
+
+// Read the counters, which run from power on and stop
+// at their maximum value
+// Request: nothing
+// Response: waterings (2), faults (2), log bytes lost (2),
+//           frames dropped for a bad CRC or LEN (2),
+//           data port IN packets (4), data port IN bytes (4)
+#define PROTOCOL_CMD_GET_COUNTERS         0x04
+#define PROTOCOL_GET_COUNTERS_RSP_LEN     16
+
+// Run the motor, if it isn't already running
+// Request: run time in ms (2)
+// Response: nothing
+#define PROTOCOL_CMD_MOTOR_TEST           0x05
+#define PROTOCOL_MOTOR_TEST_REQ_LEN       2
+
+// Start, change or stop telemetry, see PROTOCOL_TELEMETRY
+// Request: ms between records (2), 0 to stop
+// Response: nothing
+#define PROTOCOL_CMD_SET_TELEMETRY        0x06
+#define PROTOCOL_SET_TELEMETRY_REQ_LEN    2
+#define PROTOCOL_TELEMETRY_MS_MIN         100
+
+// Telemetry, sent unasked while it is on.  TAG counts the
+// frames, so the host can spot lost ones, and the payload
+// is the record layout version (1) then one or more
+// records, oldest first, each: ms since power on, counted
+// while awake (4), PROTOCOL_FLAG_xxx (1), watchdog periods
+// until the next watering (2), waterings (2), faults (2)
+#define PROTOCOL_TELEMETRY                0xFF
+#define PROTOCOL_TELEMETRY_VERSION        1
+#define PROTOCOL_TELEMETRY_RECORD_LEN     11
+#define PROTOCOL_TELEMETRY_RECORDS_MAX    ((PROTOCOL_FRAME_MAX - PROTOCOL_OVERHEAD - 1) / PROTOCOL_TELEMETRY_RECORD_LEN)
+
+// Read the history kept in flash, see history.h.  The
+// response is followed on the data port by PROTOCOL_HISTORY
+// frames holding the records, oldest first
+// Request: sequence number of the oldest record wanted (2)
+// Response: number of records to come (2)
+#define PROTOCOL_CMD_GET_HISTORY          0x07
+#define PROTOCOL_GET_HISTORY_REQ_LEN      2
+#define PROTOCOL_GET_HISTORY_RSP_LEN      2
+
+// Read how much time USB takes in the interrupt, counted
+// from power on: the number of USB interrupts (4) and the
+// instruction cycles spent in them (4), both 0 if the
+// build doesn't measure it
+#define PROTOCOL_CMD_GET_USB_LOAD         0x08
+#define PROTOCOL_GET_USB_LOAD_RSP_LEN     8
+
+// History records, sent after a GET_HISTORY response.  TAG
+// counts the frames from 0 and the payload is the number of
+// records still to come after this frame (2) then up to
+// PROTOCOL_HISTORY_RECORDS_MAX records, each: sequence
+// number (2), HISTORY_TYPE (1), argument (1), watchdog
+// periods since reset (3), check (1).  Every frame but the
+// last is PROTOCOL_FRAME_MAX bytes long
+#define PROTOCOL_HISTORY                  0xFE
+#define PROTOCOL_HISTORY_RECORD_LEN       8
+#define PROTOCOL_HISTORY_RECORDS_MAX      ((PROTOCOL_FRAME_MAX - PROTOCOL_OVERHEAD - 2) / PROTOCOL_HISTORY_RECORD_LEN)
+
+// Little-endian access to payloads
+#define PROTOCOL_GET_UINT16(p)            ((uint16_t) (p)[0] | ((uint16_t) (p)[1] << 8))
+#define PROTOCOL_PUT_UINT16(p, v)         {(p)[0] = (uint8_t) (v); (p)[1] = (uint8_t) ((v) >> 8);}
+#define PROTOCOL_PUT_UINT32(p, v)         {PROTOCOL_PUT_UINT16(p, (uint16_t) (v)); PROTOCOL_PUT_UINT16((p) + 2, (uint16_t) ((v) >> 16));}
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Add length bytes to a CRC-16/CCITT-FALSE, which starts
+ * at 0xFFFF */
+uint16_t protocolCrc16(uint16_t crc, const uint8_t *pData, uint8_t length);
+
+/* Complete a frame in pFrame whose payload, of length bytes,
+ * is already in place at PROTOCOL_OFFSET_PAYLOAD: fill in
+ * SYNC, LEN, TAG and CMD, append the CRC and return the
+ * length of the whole frame */
+uint8_t protocolFrameEnd(uint8_t *pFrame, uint8_t tag, uint8_t command, uint8_t length);
+
+#endif	/* PROTOCOL_H */
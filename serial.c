@@ -0,0 +1,147 @@
+/*
+ * File:   serial.c
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 23:40
+ */
+
+#include <xc.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "flash.h"
+#include "protocol.h"
+#include "serial.h"
+
+/********************************************************
+ * MACROS
+ *******************************************************/
+
+// The last row of HEF; the configuration is at the start
+#define SERIAL_START                 0x1FE0
+
+#if (SERIAL_START != FLASH_HEF_END + 1 - FLASH_ROW_WORDS)
+# error "The serial number must be in the last row of HEF."
+#endif
+
+// USB_DESCRIPTOR_STRING
+#define SERIAL_DESCRIPTOR_TYPE       0x03
+
+// Timer1 counting LFINTOSC, for generating the serial number
+#define TIMER1_T1CON_LFINTOSC        0xC1
+
+// How many times the instruction clock is sampled against
+// LFINTOSC; half go into each half of the serial number
+#define SERIAL_SAMPLES               64
+
+/********************************************************
+ * STATIC FUNCTION PROTOTYPES
+ *******************************************************/
+
+static bool isValid(const uint8_t *pDescriptor);
+static uint32_t generate(void);
+
+/********************************************************
+ * PUBLIC VARIABLES
+ *******************************************************/
+
+/* Empty, see serial.h */
+const uint8_t serialDescriptor[SERIAL_DESCRIPTOR_LEN] @ SERIAL_START = {0};
+
+/********************************************************
+ * PRIVATE VARIABLES
+ *******************************************************/
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+/********************************************************
+ * STATIC FUNCTIONS
+ *******************************************************/
+
+/* Return true if a descriptor holds a serial number, i.e.
+ * wasn't left half written when the power went */
+static bool isValid(const uint8_t *pDescriptor)
+{
+    uint8_t x;
+
+    if ((pDescriptor[0] != SERIAL_DESCRIPTOR_LEN) ||
+        (pDescriptor[1] != SERIAL_DESCRIPTOR_TYPE))
+    {
+        return false;
+    }
+    for (x = 2; x < SERIAL_DESCRIPTOR_LEN; x += 2)
+    {
+        if ((pDescriptor[x + 1] != 0) ||
+            !(((pDescriptor[x] >= '0') && (pDescriptor[x] <= '9')) ||
+              ((pDescriptor[x] >= 'A') && (pDescriptor[x] <= 'F'))))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Make up a serial number from the jitter between two
+ * oscillators that have nothing to do with each other: the
+ * instruction clock, counted by Timer0, is sampled on each
+ * tick of LFINTOSC, counted by Timer1, and the samples
+ * hashed.  Timer1 is put back as it was, since it may be
+ * running for the USB load measurement, see system.h, which
+ * only uses differences and so doesn't mind the count */
+static uint32_t generate(void)
+{
+    uint16_t crc[2] = {0xFFFF, 0xFFFF};
+    uint8_t t1con;
+    uint8_t sample;
+    uint8_t tick;
+    uint8_t x;
+
+    OPTION_REGbits.TMR0CS = 0;
+    OPTION_REGbits.PSA = 1;
+    t1con = T1CON;
+    T1CON = TIMER1_T1CON_LFINTOSC;
+    for (x = 0; x < SERIAL_SAMPLES; x++)
+    {
+        tick = TMR1L;
+        while (TMR1L == tick)
+        {
+        }
+        sample = TMR0;
+        crc[x & 1] = protocolCrc16(crc[x & 1], &sample, 1);
+    }
+    T1CON = t1con;
+
+    return ((uint32_t) crc[1] << 16) | crc[0];
+}
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Generate a serial number if there isn't one */
+void serialInit(void)
+{
+    uint8_t descriptor[SERIAL_DESCRIPTOR_LEN];
+    uint32_t serial;
+    uint8_t x;
+
+    /* Read with flashRead() rather than through
+     * serialDescriptor, which the compiler knows as {0} */
+    flashRead(SERIAL_START, descriptor, sizeof(descriptor));
+    if (isValid(descriptor))
+    {
+        return;
+    }
+
+    serial = generate();
+    descriptor[0] = SERIAL_DESCRIPTOR_LEN;
+    descriptor[1] = SERIAL_DESCRIPTOR_TYPE;
+    for (x = SERIAL_DESCRIPTOR_LEN - 2; x >= 2; x -= 2)
+    {
+        descriptor[x] = hexDigits[serial & 0x0F];
+        descriptor[x + 1] = 0;
+        serial >>= 4;
+    }
+    flashEraseRow(SERIAL_START);
+    flashWrite(SERIAL_START, descriptor, sizeof(descriptor));
+}
@@ -0,0 +1,44 @@
+/*
+ * File:   serial.h
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 23:40
+ */
+
+#ifndef SERIAL_H
+#define	SERIAL_H
+
+#include <stdint.h>
+
+/* Each unit has its own serial number, SERIAL_DIGITS hex
+ * digits generated the first time it boots and kept in the
+ * last row of HEF as a ready-made USB string descriptor, so
+ * that the USB stack sends it straight from flash.  The
+ * descriptor is left empty in the hex file, so programming
+ * the part gives it a new serial number unless that row,
+ * 0x1FE0 to 0x1FFF, is in the programmer's preserved range */
+
+/********************************************************
+ * MACROS
+ *******************************************************/
+
+#define SERIAL_DIGITS          8
+#define SERIAL_DESCRIPTOR_LEN  (2 + SERIAL_DIGITS * 2)
+
+/********************************************************
+ * PUBLIC VARIABLES
+ *******************************************************/
+
+/* The string descriptor, in flash */
+extern const uint8_t serialDescriptor[SERIAL_DESCRIPTOR_LEN];
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Make sure that serialDescriptor holds a serial number,
+ * generating one if it doesn't, which takes around 6 ms.
+ * Call at boot, before USBDeviceAttach() */
+void serialInit(void);
+
+#endif	/* SERIAL_H */
@@ -0,0 +1,108 @@
+/*
+ * File:   telemetry.c
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 21:20
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "usb\usb_device.h"
+#include "usb\usb_device_cdc.h"
+#include "protocol.h"
+#include "command.h"
+#include "telemetry.h"
+
+/********************************************************
+ * MACROS
+ *******************************************************/
+
+#if !defined(USB_CDC_TX_RING_SIZE)
+# error "Telemetry is batched with holdUSBUSART(), which needs the CDC transmit ring."
+#endif
+#if (PROTOCOL_TELEMETRY_RECORDS_MAX < 1)
+# error "A telemetry frame must have room for a record."
+#endif
+
+/********************************************************
+ * PRIVATE VARIABLES
+ *******************************************************/
+
+/* Time between records, 0 when telemetry is off */
+static uint16_t intervalMs = 0;
+/* When the last record was taken */
+static uint32_t lastMs = 0;
+/* The TAG of the next frame */
+static uint8_t sequence = 0;
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Set the time between records */
+void telemetrySetInterval(uint16_t milliseconds)
+{
+    intervalMs = milliseconds;
+    if ((intervalMs == 0) && (USBUSARTTxHeld() > 0))
+    {
+        submitUSBUSART(USBUSARTTxHeld());
+    }
+}
+
+/* Add a record to the frame in the transmit buffer, if
+ * one is due.  Records that fall due while we can't send,
+ * e.g. while watering, are skipped rather than caught up on
+ * afterwards */
+void telemetryService(uint8_t *pTxBuffer, uint32_t nowMs)
+{
+    uint8_t *pRecord;
+    uint8_t length;
+    uint8_t tag;
+    uint16_t periodsRemaining;
+    uint16_t waterings;
+    uint16_t faults;
+
+    if ((intervalMs == 0) || (nowMs - lastMs < intervalMs))
+    {
+        return;
+    }
+    lastMs = nowMs;
+
+    /* The frame held in the buffer may be sent whenever it
+     * isn't reserved, so it is always left complete.  It is
+     * added to, under the caller's reservation, which keeps
+     * the transmit ring from sending it half rewritten, by
+     * writing a record over its CRC and finishing it again */
+    length = USBUSARTTxHeld();
+    if (length == 0)
+    {
+        pTxBuffer[PROTOCOL_OFFSET_PAYLOAD] = PROTOCOL_TELEMETRY_VERSION;
+        length = 1;
+        tag = sequence;
+        sequence++;
+    }
+    else
+    {
+        length -= PROTOCOL_OVERHEAD;
+        tag = pTxBuffer[PROTOCOL_OFFSET_TAG];
+    }
+
+    pRecord = pTxBuffer + PROTOCOL_OFFSET_PAYLOAD + length;
+    PROTOCOL_PUT_UINT32(pRecord, nowMs);
+    pRecord[4] = appGetStatus(&periodsRemaining);
+    PROTOCOL_PUT_UINT16(pRecord + 5, periodsRemaining);
+    appGetCounters(&waterings, &faults);
+    PROTOCOL_PUT_UINT16(pRecord + 7, waterings);
+    PROTOCOL_PUT_UINT16(pRecord + 9, faults);
+
+    length = protocolFrameEnd(pTxBuffer, tag, PROTOCOL_TELEMETRY,
+                              length + PROTOCOL_TELEMETRY_RECORD_LEN);
+    if (length + PROTOCOL_TELEMETRY_RECORD_LEN > PROTOCOL_FRAME_MAX)
+    {
+        submitUSBUSART(length);
+    }
+    else
+    {
+        holdUSBUSART(length);
+    }
+}
@@ -0,0 +1,30 @@
+/*
+ * File:   telemetry.h
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 21:20
+ */
+
+#ifndef TELEMETRY_H
+#define	TELEMETRY_H
+
+#include <stdint.h>
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* Set the time between telemetry records, 0 to stop; any
+ * records waiting to go are sent when telemetry stops */
+void telemetrySetInterval(uint16_t milliseconds);
+
+/* If a telemetry record is due, add it to the PROTOCOL_TELEMETRY
+ * frame being built in pTxBuffer, the buffer returned by
+ * reserveUSBUSART() and still reserved, starting a new one if
+ * none is held there.  The frame is held with holdUSBUSART(),
+ * which ends the reservation, until it is full, or until
+ * something else is to be sent, see USBUSARTTxHeld().  nowMs
+ * is the time now, in ms */
+void telemetryService(uint8_t *pTxBuffer, uint32_t nowMs);
+
+#endif	/* TELEMETRY_H */
@@ -0,0 +1,53 @@
+/*
+ * File:   usb_device.h
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 22:40
+ */
+
+/* Stands in for the USB stack's usb_device.h in host builds,
+ * with just what command.c uses of control transfers; the
+ * test provides the functions and SetupPkt */
+
+#ifndef USB_DEVICE_H
+#define	USB_DEVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define USB_SETUP_DEVICE_TO_HOST_BITFIELD   1
+#define USB_SETUP_TYPE_VENDOR_BITFIELD      2
+#define USB_SETUP_RECIPIENT_DEVICE_BITFIELD 0
+#define USB_EP0_NO_OPTIONS                  0x00
+
+/* The fields of a setup packet that command.c looks at */
+typedef struct
+{
+    uint8_t Recipient;
+    uint8_t RequestType;
+    uint8_t DataDir;
+    uint8_t bRequest;
+    struct
+    {
+        struct
+        {
+            uint8_t LB;
+            uint8_t HB;
+        } byte;
+    } W_Value, W_Index;
+    uint16_t wLength;
+} CTRL_TRF_SETUP;
+
+extern volatile CTRL_TRF_SETUP SetupPkt;
+
+void USBMaskInterrupts(void);
+void USBUnmaskInterrupts(void);
+void USBDeferINDataStage(void);
+void USBDeferStatusStage(void);
+bool USBINDataStageDeferred(void);
+void USBEP0SendRAMPtr(uint8_t *pData, uint16_t length, uint8_t options);
+void USBCtrlEPAllowDataStage(void);
+void USBCtrlEPAllowStatusStage(void);
+
+#endif	/* USB_DEVICE_H */
@@ -0,0 +1,33 @@
+/*
+ * File:   usb_device_cdc.h
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 22:40
+ */
+
+/* Stands in for the CDC driver's usb_device_cdc.h in host
+ * builds, with just what history.c and command.c use; the
+ * endpoint sizes are the real ones and the test provides the
+ * functions */
+
+#ifndef USB_DEVICE_CDC_H
+#define	USB_DEVICE_CDC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "usb/usb_config.h"
+
+typedef uint8_t (*CDC_TX_PRODUCER)(uint8_t *buffer, uint8_t length);
+
+typedef struct
+{
+    uint32_t packets;
+    uint32_t bytes;
+} CDC_TX_COUNTERS;
+
+bool streamUSBUSART(CDC_TX_PRODUCER producer);
+uint8_t readCmdUSBUSART(uint8_t *buffer, uint8_t len);
+void getUSBUSARTTxCounters(CDC_TX_COUNTERS *counters, bool clear);
+uint16_t USBUSARTTxOverflowCount(void);
+
+#endif	/* USB_DEVICE_CDC_H */
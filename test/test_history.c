@@ -0,0 +1,218 @@
+/*
+ * File:   test_history.c
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 22:40
+ */
+
+/* Host simulation of history.c: a year of watering, at the
+ * default schedule and at ten a day, with a reset now and
+ * then, run against a flash that counts the erases of each
+ * row, checking that the rows wear evenly and as little as
+ * history.h says */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "flash.h"
+#include "protocol.h"
+#include "history.h"
+#include "usb/usb_device_cdc.h"
+
+/********************************************************
+ * MACROS
+ *******************************************************/
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+// The part of flash the history may use, everything below HEF
+#define FLASH_WORDS              (FLASH_HEF_START - FLASH_DATA_START)
+#define FLASH_ROWS               (FLASH_WORDS / FLASH_ROW_WORDS)
+
+#define RECORDS_PER_ROW          (FLASH_ROW_WORDS / PROTOCOL_HISTORY_RECORD_LEN)
+#define NUM_RECORDS              (HISTORY_NUM_ROWS * RECORDS_PER_ROW)
+
+// A year in watchdog periods of 256 seconds
+#define YEAR_PERIODS             (365UL * 24 * 60 * 60 / 256)
+// The default schedule, see main.c, and about ten a day
+#define DEFAULT_PERIODS          1000
+#define TEN_A_DAY_PERIODS        34
+// A reset, e.g. a battery change, every month or so
+#define RESET_PERIODS            (30UL * 24 * 60 * 60 / 256)
+
+/********************************************************
+ * PRIVATE VARIABLES
+ *******************************************************/
+
+static unsigned int failures = 0;
+
+/* The low byte of each word of flash and the erases per row */
+static uint8_t flash[FLASH_WORDS];
+static unsigned long erases[FLASH_ROWS];
+
+/********************************************************
+ * STATIC FUNCTIONS
+ *******************************************************/
+
+static void check(bool condition, const char *pText, int line)
+{
+    if (!condition)
+    {
+        printf("test_history.c:%d: failed: %s\n", line, pText);
+        failures++;
+    }
+}
+
+/* A fresh part, everything erased */
+static void flashReset(void)
+{
+    memset(flash, 0xFF, sizeof(flash));
+    memset(erases, 0, sizeof(erases));
+}
+
+/* Add the records of one reset and commit them */
+static uint16_t powerOn(void)
+{
+    historyInit();
+    historyAdd(HISTORY_TYPE_RESET, 0x1F, 0);
+    while (historyQueued())
+    {
+        historyCommit();
+    }
+
+    return 1;
+}
+
+/* Add the records of one watering, as main() does, and commit
+ * them as the main loop would while waiting for the switch */
+static uint16_t water(uint32_t periods)
+{
+    historyAdd(HISTORY_TYPE_CYCLE_START, 0, periods);
+    historyAdd(HISTORY_TYPE_SWITCH_CLOSED, 15, periods);
+    historyAdd(HISTORY_TYPE_SWITCH_RELEASED, 0, periods);
+    while (historyQueued())
+    {
+        historyCommit();
+    }
+
+    return 3;
+}
+
+/* Run a year at one watering every wateringPeriods, checking
+ * the wear against maxErases */
+static void simulateYear(const char *pName, uint32_t wateringPeriods,
+                         unsigned long maxErases)
+{
+    unsigned long records = 0;
+    unsigned long least = 0xFFFFFFFFUL;
+    unsigned long most = 0;
+    uint32_t periods;
+    uint32_t sinceReset = 0;
+    uint16_t x;
+
+    flashReset();
+    records += powerOn();
+    for (periods = wateringPeriods; periods <= YEAR_PERIODS; periods += wateringPeriods)
+    {
+        sinceReset += wateringPeriods;
+        if (sinceReset >= RESET_PERIODS)
+        {
+            records += powerOn();
+            sinceReset = 0;
+        }
+        records += water(sinceReset);
+    }
+
+    for (x = 0; x < FLASH_ROWS; x++)
+    {
+        if (x < HISTORY_NUM_ROWS)
+        {
+            if (erases[x] < least)
+            {
+                least = erases[x];
+            }
+            if (erases[x] > most)
+            {
+                most = erases[x];
+            }
+        }
+        else
+        {
+            /* Nothing outside the history is touched */
+            CHECK(erases[x] == 0);
+        }
+    }
+    printf("test_history: %s, %lu records, %lu to %lu erases a row\n",
+           pName, records, least, most);
+
+    /* Every row wears at the same rate, a row being erased
+     * once for each pass of the log */
+    CHECK(most - least <= 1);
+    CHECK(most <= (records + NUM_RECORDS - 1) / NUM_RECORDS);
+    CHECK(most <= maxErases);
+
+    /* After all that, the newest records read back */
+    CHECK(historyStart((uint16_t) (records - 10)) == 10);
+    CHECK(historyStart((uint16_t) records) == 0);
+}
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+/* The flash, see flash.h */
+void flashRead(uint16_t address, uint8_t *pData, uint8_t length)
+{
+    CHECK((address >= FLASH_DATA_START) && (address + length <= FLASH_HEF_START));
+    memcpy(pData, flash + address - FLASH_DATA_START, length);
+}
+
+void flashEraseRow(uint16_t address)
+{
+    uint16_t row = (address - FLASH_DATA_START) / FLASH_ROW_WORDS;
+
+    CHECK((address >= FLASH_DATA_START) && (address < FLASH_HEF_START));
+    CHECK((address % FLASH_ROW_WORDS) == 0);
+    memset(flash + row * FLASH_ROW_WORDS, 0xFF, FLASH_ROW_WORDS);
+    erases[row]++;
+}
+
+void flashWrite(uint16_t address, const uint8_t *pData, uint8_t length)
+{
+    uint8_t x;
+
+    CHECK((address >= FLASH_DATA_START) && (address + length <= FLASH_HEF_START));
+    CHECK((address / FLASH_ROW_WORDS) == ((address + length - 1) / FLASH_ROW_WORDS));
+    for (x = 0; x < length; x++)
+    {
+        /* Flash can only be written once between erases */
+        CHECK(flash[address - FLASH_DATA_START + x] == 0xFF);
+        flash[address - FLASH_DATA_START + x] = pData[x];
+    }
+}
+
+/* The read-out isn't run here */
+bool streamUSBUSART(CDC_TX_PRODUCER producer)
+{
+    (void) producer;
+
+    return false;
+}
+
+int main(void)
+{
+    /* history.h: about 11 erases a row a year by default and
+     * under 400 at ten waterings a day */
+    simulateYear("default schedule", DEFAULT_PERIODS, 12);
+    simulateYear("ten a day", TEN_A_DAY_PERIODS, 399);
+
+    if (failures > 0)
+    {
+        printf("test_history: %u failure(s)\n", failures);
+        return 1;
+    }
+    printf("test_history: passed\n");
+
+    return 0;
+}
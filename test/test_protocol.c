@@ -0,0 +1,586 @@
+/*
+ * File:   test_protocol.c
+ * Author: Rob Meades
+ *
+ * Created on 18 October 2026, 22:10
+ */
+
+/* Host tests for protocol.c and the receiving side of
+ * command.c: the CRC against its published check value,
+ * frames encoded by protocolFrameEnd() and requests fed to
+ * commandService() through a stand-in readCmdUSBUSART(),
+ * whole, split at every offset and back to back, then vendor
+ * requests through stand-ins for the control endpoint */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "usb/usb_device.h"
+#include "usb/usb_device_cdc.h"
+#include "protocol.h"
+#include "command.h"
+#include "telemetry.h"
+#include "history.h"
+#include "config.h"
+
+/********************************************************
+ * MACROS
+ *******************************************************/
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+/* Bytes the stand-in command port can hold */
+#define WIRE_SIZE 256
+
+/* The length of a response frame with dataLength bytes of
+ * response data after its status */
+#define RESPONSE_LENGTH(dataLength) (PROTOCOL_OVERHEAD + 1 + (dataLength))
+
+/********************************************************
+ * PRIVATE VARIABLES
+ *******************************************************/
+
+static unsigned int failures = 0;
+
+/* What the host has sent on the command port and how much of
+ * it command.c has read */
+static uint8_t wire[WIRE_SIZE];
+static unsigned int wireLength = 0;
+static unsigned int wireRead = 0;
+
+/* The schedule as the application would hold it */
+static uint16_t schedulePeriods = 1000;
+static uint16_t scheduleMotorMs = 2000;
+static unsigned int scheduleSets = 0;
+/* configPending(), which appSetSchedule() sets as
+ * configSave() would */
+static bool configWaiting = false;
+
+/* The state of the control transfer */
+static bool inDataDeferred = false;
+static bool statusAllowed = false;
+static uint16_t sentLength = 0;
+
+/********************************************************
+ * STATIC FUNCTIONS
+ *******************************************************/
+
+static void check(bool condition, const char *pText, int line)
+{
+    if (!condition)
+    {
+        printf("test_protocol.c:%d: failed: %s\n", line, pText);
+        failures++;
+    }
+}
+
+/* The host sends length bytes on the command port */
+static void wirePut(const uint8_t *pData, unsigned int length)
+{
+    if (wireRead == wireLength)
+    {
+        wireRead = 0;
+        wireLength = 0;
+    }
+    CHECK(wireLength + length <= sizeof(wire));
+    while ((length > 0) && (wireLength < sizeof(wire)))
+    {
+        wire[wireLength] = *pData;
+        wireLength++;
+        pData++;
+        length--;
+    }
+}
+
+/* Build a request with no payload in pFrame, returning its
+ * length */
+static uint8_t requestEmpty(uint8_t *pFrame, uint8_t tag, uint8_t command)
+{
+    return protocolFrameEnd(pFrame, tag, command, 0);
+}
+
+/* Build a SET_SCHEDULE request in pFrame, returning its
+ * length */
+static uint8_t requestSetSchedule(uint8_t *pFrame, uint8_t tag,
+                                  uint16_t periods, uint16_t motorMs)
+{
+    PROTOCOL_PUT_UINT16(pFrame + PROTOCOL_OFFSET_PAYLOAD, periods);
+    PROTOCOL_PUT_UINT16(pFrame + PROTOCOL_OFFSET_PAYLOAD + 2, motorMs);
+
+    return protocolFrameEnd(pFrame, tag, PROTOCOL_CMD_SET_SCHEDULE,
+                            PROTOCOL_SET_SCHEDULE_REQ_LEN);
+}
+
+/* Whether pFrame is a good response to command, with the
+ * given tag, status and length of response data */
+static bool responseIs(const uint8_t *pFrame, uint8_t tag, uint8_t command,
+                       uint8_t status, uint8_t dataLength)
+{
+    uint8_t total = RESPONSE_LENGTH(dataLength);
+
+    return (pFrame[0] == PROTOCOL_SYNC) &&
+           (pFrame[PROTOCOL_OFFSET_LEN] == dataLength + 3) &&
+           (pFrame[PROTOCOL_OFFSET_TAG] == tag) &&
+           (pFrame[PROTOCOL_OFFSET_CMD] == (command | PROTOCOL_RESPONSE)) &&
+           (pFrame[PROTOCOL_OFFSET_PAYLOAD] == status) &&
+           (protocolCrc16(0xFFFF, pFrame + PROTOCOL_OFFSET_LEN, dataLength + 4) ==
+            PROTOCOL_GET_UINT16(pFrame + total - 2));
+}
+
+/* The frames command.c has thrown away, from GET_COUNTERS */
+static uint16_t droppedFrames(void)
+{
+    uint8_t request[PROTOCOL_REQUEST_FRAME_MAX];
+    uint8_t response[PROTOCOL_FRAME_MAX];
+
+    wirePut(request, requestEmpty(request, 0xDC, PROTOCOL_CMD_GET_COUNTERS));
+    CHECK(commandService(response) == RESPONSE_LENGTH(PROTOCOL_GET_COUNTERS_RSP_LEN));
+    CHECK(responseIs(response, 0xDC, PROTOCOL_CMD_GET_COUNTERS,
+                     PROTOCOL_STATUS_OK, PROTOCOL_GET_COUNTERS_RSP_LEN));
+
+    return PROTOCOL_GET_UINT16(response + PROTOCOL_OFFSET_PAYLOAD + 1 + 6);
+}
+
+/* CRC-16/CCITT-FALSE: the catalogue check value and that
+ * it may be worked out a piece at a time */
+static void testCrc(void)
+{
+    const uint8_t digits[] = "123456789";
+    uint16_t crc;
+
+    CHECK(protocolCrc16(0xFFFF, digits, 9) == 0x29B1);
+    CHECK(protocolCrc16(0xFFFF, digits, 0) == 0xFFFF);
+
+    crc = protocolCrc16(0xFFFF, digits, 4);
+    crc = protocolCrc16(crc, digits + 4, 5);
+    CHECK(crc == 0x29B1);
+}
+
+/* The little-endian payload macros */
+static void testEndian(void)
+{
+    uint8_t buffer[4];
+
+    PROTOCOL_PUT_UINT16(buffer, 0x1234);
+    CHECK((buffer[0] == 0x34) && (buffer[1] == 0x12));
+    CHECK(PROTOCOL_GET_UINT16(buffer) == 0x1234);
+
+    PROTOCOL_PUT_UINT32(buffer, 0x89ABCDEFUL);
+    CHECK((buffer[0] == 0xEF) && (buffer[1] == 0xCD) &&
+          (buffer[2] == 0xAB) && (buffer[3] == 0x89));
+    CHECK(PROTOCOL_GET_UINT16(buffer) == 0xCDEF);
+    CHECK(PROTOCOL_GET_UINT16(buffer + 2) == 0x89AB);
+}
+
+/* Frames worked out by hand, so that the encoder and the CRC
+ * can't drift together */
+static void testKnownFrames(void)
+{
+    const uint8_t getStatus[] = {0xA5, 0x02, 0x01, 0x01, 0xEC, 0x81};
+    const uint8_t setTelemetry[] = {0xA5, 0x04, 0x2A, 0x06, 0x2C, 0x01, 0xE5, 0x26};
+    uint8_t frame[PROTOCOL_FRAME_MAX];
+    uint8_t length;
+
+    length = protocolFrameEnd(frame, 0x01, PROTOCOL_CMD_GET_STATUS, 0);
+    CHECK(length == sizeof(getStatus));
+    CHECK(memcmp(frame, getStatus, sizeof(getStatus)) == 0);
+
+    PROTOCOL_PUT_UINT16(frame + PROTOCOL_OFFSET_PAYLOAD, 300);
+    length = protocolFrameEnd(frame, 0x2A, PROTOCOL_CMD_SET_TELEMETRY,
+                              PROTOCOL_SET_TELEMETRY_REQ_LEN);
+    CHECK(length == sizeof(setTelemetry));
+    CHECK(memcmp(frame, setTelemetry, sizeof(setTelemetry)) == 0);
+}
+
+/* Every payload length that fits a request frame is received
+ * whole and checked against the command's */
+static void testLengths(void)
+{
+    uint8_t request[PROTOCOL_REQUEST_FRAME_MAX];
+    uint8_t response[PROTOCOL_FRAME_MAX];
+    uint8_t length;
+    uint8_t x;
+
+    for (length = 0; length <= PROTOCOL_REQUEST_FRAME_MAX - PROTOCOL_OVERHEAD; length++)
+    {
+        for (x = 0; x < length; x++)
+        {
+            request[PROTOCOL_OFFSET_PAYLOAD + x] = (uint8_t) (length * 7 + x);
+        }
+        wirePut(request, protocolFrameEnd(request, length,
+                                          PROTOCOL_CMD_GET_SCHEDULE, length));
+        if (length == 0)
+        {
+            CHECK(commandService(response) == RESPONSE_LENGTH(PROTOCOL_GET_SCHEDULE_RSP_LEN));
+            CHECK(responseIs(response, length, PROTOCOL_CMD_GET_SCHEDULE,
+                             PROTOCOL_STATUS_OK, PROTOCOL_GET_SCHEDULE_RSP_LEN));
+        }
+        else
+        {
+            CHECK(commandService(response) == RESPONSE_LENGTH(0));
+            CHECK(responseIs(response, length, PROTOCOL_CMD_GET_SCHEDULE,
+                             PROTOCOL_STATUS_BAD_LENGTH, 0));
+        }
+    }
+}
+
+/* A request is handled once its last byte has arrived and not
+ * before, however it is split */
+static void testSplit(void)
+{
+    uint8_t request[PROTOCOL_REQUEST_FRAME_MAX];
+    uint8_t response[PROTOCOL_FRAME_MAX];
+    uint8_t length;
+    uint8_t split;
+    uint8_t x;
+    uint8_t received;
+
+    for (split = 0; split <= PROTOCOL_OFFSET_PAYLOAD + PROTOCOL_SET_SCHEDULE_REQ_LEN + 2; split++)
+    {
+        length = requestSetSchedule(request, split, 1000 + split, 500 + split);
+        scheduleSets = 0;
+
+        wirePut(request, split);
+        received = commandService(response);
+        CHECK(received == ((split == length) ? RESPONSE_LENGTH(0) : 0));
+        wirePut(request + split, length - split);
+        if (split < length)
+        {
+            CHECK(scheduleSets == 0);
+            received = commandService(response);
+        }
+        CHECK(received == RESPONSE_LENGTH(0));
+        CHECK(responseIs(response, split, PROTOCOL_CMD_SET_SCHEDULE, PROTOCOL_STATUS_OK, 0));
+        CHECK(scheduleSets == 1);
+        CHECK((schedulePeriods == 1000 + split) && (scheduleMotorMs == 500 + split));
+    }
+
+    /* And a byte at a time */
+    length = requestSetSchedule(request, 0x77, 3000, 1500);
+    scheduleSets = 0;
+    for (x = 0; x < length; x++)
+    {
+        wirePut(request + x, 1);
+        received = commandService(response);
+        CHECK(received == ((x == length - 1) ? RESPONSE_LENGTH(0) : 0));
+    }
+    CHECK(responseIs(response, 0x77, PROTOCOL_CMD_SET_SCHEDULE, PROTOCOL_STATUS_OK, 0));
+    CHECK((scheduleSets == 1) && (schedulePeriods == 3000) && (scheduleMotorMs == 1500));
+}
+
+/* Requests sent back to back are answered in order, as many
+ * to a response buffer as fit, the rest in the next */
+static void testPipelined(void)
+{
+    uint8_t requests[PROTOCOL_REQUEST_FRAME_MAX * 4];
+    uint8_t response[PROTOCOL_FRAME_MAX];
+    const uint8_t *pResponse;
+    uint8_t length = 0;
+    uint8_t received;
+    uint8_t tag;
+    uint8_t buffers;
+
+    length += requestSetSchedule(requests + length, 1, 5000, 600);
+    length += requestEmpty(requests + length, 2, PROTOCOL_CMD_GET_SCHEDULE);
+    length += requestEmpty(requests + length, 3, PROTOCOL_CMD_GET_STATUS);
+    wirePut(requests, length);
+
+    received = commandService(response);
+    CHECK(received == RESPONSE_LENGTH(0) + RESPONSE_LENGTH(PROTOCOL_GET_SCHEDULE_RSP_LEN) +
+                      RESPONSE_LENGTH(PROTOCOL_GET_STATUS_RSP_LEN));
+    pResponse = response;
+    CHECK(responseIs(pResponse, 1, PROTOCOL_CMD_SET_SCHEDULE, PROTOCOL_STATUS_OK, 0));
+    pResponse += RESPONSE_LENGTH(0);
+    CHECK(responseIs(pResponse, 2, PROTOCOL_CMD_GET_SCHEDULE,
+                     PROTOCOL_STATUS_OK, PROTOCOL_GET_SCHEDULE_RSP_LEN));
+    CHECK(PROTOCOL_GET_UINT16(pResponse + PROTOCOL_OFFSET_PAYLOAD + 1) == 5000);
+    CHECK(PROTOCOL_GET_UINT16(pResponse + PROTOCOL_OFFSET_PAYLOAD + 3) == 600);
+    pResponse += RESPONSE_LENGTH(PROTOCOL_GET_SCHEDULE_RSP_LEN);
+    CHECK(responseIs(pResponse, 3, PROTOCOL_CMD_GET_STATUS,
+                     PROTOCOL_STATUS_OK, PROTOCOL_GET_STATUS_RSP_LEN));
+    CHECK(commandService(response) == 0);
+
+    /* Four GET_COUNTERS responses don't fit one buffer */
+    length = 0;
+    for (tag = 0; tag < 4; tag++)
+    {
+        length += requestEmpty(requests + length, tag, PROTOCOL_CMD_GET_COUNTERS);
+    }
+    wirePut(requests, length);
+    tag = 0;
+    buffers = 0;
+    while ((received = commandService(response)) > 0)
+    {
+        buffers++;
+        CHECK(received % RESPONSE_LENGTH(PROTOCOL_GET_COUNTERS_RSP_LEN) == 0);
+        for (pResponse = response; pResponse < response + received;
+             pResponse += RESPONSE_LENGTH(PROTOCOL_GET_COUNTERS_RSP_LEN))
+        {
+            CHECK(responseIs(pResponse, tag, PROTOCOL_CMD_GET_COUNTERS,
+                             PROTOCOL_STATUS_OK, PROTOCOL_GET_COUNTERS_RSP_LEN));
+            tag++;
+        }
+    }
+    CHECK(tag == 4);
+    CHECK(buffers > 1);
+}
+
+/* A request with any single bit changed after SYNC, or cut
+ * short, is dropped and counted, and the one after it is
+ * still received */
+static void testCorruption(void)
+{
+    uint8_t request[PROTOCOL_REQUEST_FRAME_MAX];
+    uint8_t response[PROTOCOL_FRAME_MAX];
+    const uint8_t zeros[PROTOCOL_REQUEST_FRAME_MAX] = {0};
+    uint16_t dropped;
+    uint8_t length;
+    uint8_t received;
+    uint8_t x;
+    uint8_t bit;
+
+    memset(request, 0, sizeof(request));
+    length = requestSetSchedule(request, 0x55, 0x0102, 0x0304);
+    scheduleSets = 0;
+    dropped = droppedFrames();
+
+    for (x = PROTOCOL_OFFSET_LEN; x < length; x++)
+    {
+        for (bit = 0; bit < 8; bit++)
+        {
+            request[x] ^= 1 << bit;
+            wirePut(request, length);
+            received = commandService(response);
+            /* Whatever a bad LEN says is still to come */
+            wirePut(zeros, sizeof(zeros));
+            received += commandService(response);
+            CHECK(received == 0);
+            request[x] ^= 1 << bit;
+            CHECK(droppedFrames() > dropped);
+            dropped = droppedFrames();
+        }
+    }
+
+    wirePut(request, length - 1);
+    received = commandService(response);
+    wirePut(zeros, sizeof(zeros));
+    received += commandService(response);
+    CHECK(received == 0);
+    CHECK(droppedFrames() > dropped);
+    CHECK(scheduleSets == 0);
+
+    wirePut(request, length);
+    CHECK(commandService(response) == RESPONSE_LENGTH(0));
+    CHECK(responseIs(response, 0x55, PROTOCOL_CMD_SET_SCHEDULE, PROTOCOL_STATUS_OK, 0));
+    CHECK(scheduleSets == 1);
+}
+
+/* Set up a vendor request for command, with the payload in
+ * wValue then wIndex, and pass it to command.c */
+static void vendorRequest(uint8_t command, uint16_t value, uint16_t index)
+{
+    SetupPkt.RequestType = USB_SETUP_TYPE_VENDOR_BITFIELD;
+    SetupPkt.Recipient = USB_SETUP_RECIPIENT_DEVICE_BITFIELD;
+    SetupPkt.DataDir = USB_SETUP_DEVICE_TO_HOST_BITFIELD;
+    SetupPkt.bRequest = PROTOCOL_VENDOR_REQUEST_BASE + command;
+    SetupPkt.W_Value.byte.LB = (uint8_t) value;
+    SetupPkt.W_Value.byte.HB = (uint8_t) (value >> 8);
+    SetupPkt.W_Index.byte.LB = (uint8_t) index;
+    SetupPkt.W_Index.byte.HB = (uint8_t) (index >> 8);
+    SetupPkt.wLength = PROTOCOL_FRAME_MAX;
+    sentLength = 0;
+    commandCheckVendorRequest();
+}
+
+/* A vendor request is answered straight away unless it has
+ * changed the configuration, when neither the data stage nor
+ * the status stage may go until the change reads back from
+ * flash, however long that takes */
+static void testVendorCommit(void)
+{
+    configWaiting = false;
+    vendorRequest(PROTOCOL_CMD_GET_SCHEDULE, 0, 0);
+    CHECK(inDataDeferred && !statusAllowed);
+    commandVendorService();
+    CHECK(!inDataDeferred && statusAllowed);
+    CHECK(sentLength == 1 + PROTOCOL_GET_SCHEDULE_RSP_LEN);
+    CHECK(!commandVendorCommitting());
+
+    scheduleSets = 0;
+    vendorRequest(PROTOCOL_CMD_SET_SCHEDULE, 1234, 567);
+    commandVendorService();
+    CHECK((scheduleSets == 1) && (schedulePeriods == 1234) && (scheduleMotorMs == 567));
+    CHECK(commandVendorCommitting());
+    /* A commit that doesn't read back leaves it waiting */
+    commandVendorService();
+    commandVendorService();
+    CHECK(inDataDeferred && !statusAllowed && (sentLength == 0));
+    CHECK(scheduleSets == 1);
+
+    configWaiting = false;
+    commandVendorService();
+    CHECK(!inDataDeferred && statusAllowed && (sentLength == 1));
+    CHECK(!commandVendorCommitting());
+
+    /* A bad value changes nothing, so isn't held up */
+    vendorRequest(PROTOCOL_CMD_SET_SCHEDULE, 1234, 0);
+    commandVendorService();
+    CHECK(!inDataDeferred && statusAllowed && (sentLength == 1));
+    CHECK(!commandVendorCommitting());
+}
+
+/********************************************************
+ * PUBLIC FUNCTIONS: WHAT COMMAND.C CALLS
+ *******************************************************/
+
+volatile CTRL_TRF_SETUP SetupPkt;
+
+void USBMaskInterrupts(void)
+{
+}
+
+void USBUnmaskInterrupts(void)
+{
+}
+
+void USBDeferINDataStage(void)
+{
+    inDataDeferred = true;
+}
+
+void USBDeferStatusStage(void)
+{
+    statusAllowed = false;
+}
+
+bool USBINDataStageDeferred(void)
+{
+    return inDataDeferred;
+}
+
+void USBEP0SendRAMPtr(uint8_t *pData, uint16_t length, uint8_t options)
+{
+    (void) pData;
+    (void) options;
+    sentLength = length;
+}
+
+void USBCtrlEPAllowDataStage(void)
+{
+    inDataDeferred = false;
+}
+
+void USBCtrlEPAllowStatusStage(void)
+{
+    statusAllowed = true;
+}
+
+/* The command port: whatever the host has sent that command.c
+ * hasn't read yet */
+uint8_t readCmdUSBUSART(uint8_t *buffer, uint8_t len)
+{
+    uint8_t count = 0;
+
+    while ((count < len) && (wireRead < wireLength))
+    {
+        buffer[count] = wire[wireRead];
+        count++;
+        wireRead++;
+    }
+
+    return count;
+}
+
+void getUSBUSARTTxCounters(CDC_TX_COUNTERS *counters, bool clear)
+{
+    (void) clear;
+    counters->packets = 0;
+    counters->bytes = 0;
+}
+
+uint16_t USBUSARTTxOverflowCount(void)
+{
+    return 0;
+}
+
+uint8_t appGetStatus(uint16_t *pPeriodsRemaining)
+{
+    *pPeriodsRemaining = 0;
+
+    return 0;
+}
+
+void appGetSchedule(uint16_t *pPeriods, uint16_t *pMotorMs)
+{
+    *pPeriods = schedulePeriods;
+    *pMotorMs = scheduleMotorMs;
+}
+
+void appSetSchedule(uint16_t periods, uint16_t motorMs)
+{
+    schedulePeriods = periods;
+    scheduleMotorMs = motorMs;
+    scheduleSets++;
+    configWaiting = true;
+}
+
+void appGetCounters(uint16_t *pWaterings, uint16_t *pFaults)
+{
+    *pWaterings = 0;
+    *pFaults = 0;
+}
+
+bool appMotorTest(uint16_t milliseconds)
+{
+    (void) milliseconds;
+
+    return true;
+}
+
+void telemetrySetInterval(uint16_t milliseconds)
+{
+    (void) milliseconds;
+}
+
+uint16_t historyStart(uint16_t fromSequence)
+{
+    (void) fromSequence;
+
+    return 0;
+}
+
+bool historyPending(void)
+{
+    return false;
+}
+
+bool configPending(void)
+{
+    return configWaiting;
+}
+
+/********************************************************
+ * PUBLIC FUNCTIONS
+ *******************************************************/
+
+int main(void)
+{
+    testCrc();
+    testEndian();
+    testKnownFrames();
+    testLengths();
+    testSplit();
+    testPipelined();
+    testCorruption();
+    testVendorCommit();
+
+    if (failures > 0)
+    {
+        printf("test_protocol: %u failure(s)\n", failures);
+        return 1;
+    }
+    printf("test_protocol: passed\n");
+
+    return 0;
+}
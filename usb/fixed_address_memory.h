@@ -25,8 +25,20 @@
 
 #define FIXED_ADDRESS_MEMORY
 
-#define IN_DATA_BUFFER_ADDRESS_TAG      @0x0A0
+//The BDT for endpoints 0 to 4 and the EP0 buffers run on to 0x0AF
+#define IN_DATA_BUFFER_ADDRESS_TAG      @0x0B0
 #define OUT_DATA_BUFFER_ADDRESS_TAG     @0x120
 #define CONTROL_BUFFER_ADDRESS_TAG      @0x1A0
 
+//The second buffer of each ping-pong pair, also in USB dual port RAM
+#define IN_DATA_BUFFER_ODD_ADDRESS_TAG  @0x220
+#define OUT_DATA_BUFFER_ODD_ADDRESS_TAG @0x2A0
+//The SerialState notification, in the space after the first odd IN buffer
+#define NOTIFICATION_BUFFER_ADDRESS_TAG @0x260
+
+//The command port's buffers, see CDC_CMD_PORT, the IN buffer taking the
+//space of the unused control buffer
+#define CMD_IN_DATA_BUFFER_ADDRESS_TAG  @0x1A0
+#define CMD_OUT_DATA_BUFFER_ADDRESS_TAG @0x160
+
 #endif //FIXED_MEMORY_ADDRESS
\ No newline at end of file
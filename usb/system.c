@@ -24,6 +24,10 @@
 #include "system_config.h"
 #include "usb.h"
 
+#if defined(SYSTEM_MEASURE_USB_LOAD)
+volatile SYSTEM_USB_LOAD SYSTEM_UsbLoad;
+#endif
+
 /** CONFIGURATION Bits **********************************************/
 // PIC16F145x configuration bit settings:
 #if defined (USE_INTERNAL_OSC)	    // Define this in system.h if using the HFINTOSC for USB operation
@@ -96,6 +100,11 @@ void SYSTEM_Initialize( SYSTEM_STATE state )
                 //operation from the INTOSC
                 OSCCON = 0xFC;  //HFINTOSC @ 16MHz, 3X PLL, PLL enabled
                 ACTCON = 0x90;  //Active clock tuning enabled for USB
+#endif
+#if defined(SYSTEM_MEASURE_USB_LOAD)
+                //Timer1 free running from Fosc/4 with no prescaler, used to
+                //time the USB interrupt
+                T1CON = 0x01;
 #endif
             break;
             
@@ -107,13 +116,51 @@ void SYSTEM_Initialize( SYSTEM_STATE state )
     }
 }
 
+/*********************************************************************
+* Function: uint16_t SYSTEM_ReadTimer1(void)
+*
+* Overview: Reads the running Timer1 as one value.  The two halves
+*           can only be read a byte at a time so, if TMR1L carries
+*           into TMR1H between the reads, they are read again.
+*
+* PreCondition: None
+*
+* Input:  None
+*
+* Output: The Timer1 count
+*
+********************************************************************/
+uint16_t SYSTEM_ReadTimer1(void)
+{
+    uint8_t high;
+    uint8_t low;
+
+    do
+    {
+        high = TMR1H;
+        low = TMR1L;
+    } while (high != TMR1H);
+
+    return ((uint16_t) high << 8) | low;
+}
+
 void interrupt SYS_InterruptHigh(void)
 {
 #if defined(USB_INTERRUPT)
-    /* Handle USB activity */
-    if (PIR2bits.USBIF)
+    /* Handle USB activity, but only if the USB interrupt is enabled:
+     * with USB_HYBRID_POLLING the flag may be set while the stack
+     * is deliberately leaving it for the next poll */
+    if (PIE2bits.USBIE && PIR2bits.USBIF)
     {
+#if defined(SYSTEM_MEASURE_USB_LOAD)
+        uint16_t start = SYSTEM_ReadTimer1();
+
         USBDeviceTasks();
+        SYSTEM_UsbLoad.cycles += (uint16_t) (SYSTEM_ReadTimer1() - start);
+        SYSTEM_UsbLoad.interrupts++;
+#else
+        USBDeviceTasks();
+#endif
     }
 #endif
     
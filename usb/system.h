@@ -25,6 +25,7 @@
 
 #include <xc.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "io_mapping.h"
 #include "fixed_address_memory.h"
@@ -41,6 +42,23 @@
 
 #define MAIN_RETURN void
 
+//Define this to count the USB interrupts taken and the instruction cycles
+//spent servicing them (timed with Timer1), so that the CPU load of the USB
+//stack can be compared between interrupt and hybrid polling operation.
+//See SYSTEM_UsbLoad.
+#define SYSTEM_MEASURE_USB_LOAD
+
+/*** USB load measurements ******************************************/
+typedef struct
+{
+    uint32_t interrupts;    //Number of times USBDeviceTasks() has been run from the ISR
+    uint32_t cycles;        //Instruction cycles (Fosc/4) spent in those calls
+} SYSTEM_USB_LOAD;
+
+#if defined(SYSTEM_MEASURE_USB_LOAD)
+extern volatile SYSTEM_USB_LOAD SYSTEM_UsbLoad;
+#endif
+
 /*** System States **************************************************/
 typedef enum
 {
@@ -63,4 +81,18 @@ typedef enum
 ********************************************************************/
 void SYSTEM_Initialize( SYSTEM_STATE state );
 
+/*********************************************************************
+* Function: uint16_t SYSTEM_ReadTimer1(void)
+*
+* Overview: Reads the running Timer1 without tearing the two bytes.
+*
+* PreCondition: None
+*
+* Input:  None
+*
+* Output: The Timer1 count
+*
+********************************************************************/
+uint16_t SYSTEM_ReadTimer1(void);
+
 #endif //SYSTEM_H
@@ -59,7 +59,7 @@
 								// that use EP0 IN or OUT for sending large amounts of
 								// application related data.
 									
-#define USB_MAX_NUM_INT     	2   // For tracking Alternate Setting
+#define USB_MAX_NUM_INT     	(4 + DFU_NUM_INT)   // For tracking Alternate Setting
 
 //Device descriptor - if these two definitions are not defined then
 //  a ROM USB_DEVICE_DESCRIPTOR variable by the exact name of device_dsc
@@ -83,6 +83,17 @@
 //#define USB_POLLING
 #define USB_INTERRUPT
 
+//Hybrid polling option, only valid with USB_INTERRUPT.  The USB interrupt is
+//left enabled only while the bus is busy: during a control transfer and for
+//USB_HYBRID_IDLE_TIMEOUT ms after any transaction completes.  Once the bus goes
+//quiet the 1 kHz SOF interrupt is no longer taken and the stack is serviced
+//instead when the application calls USBHybridPoll(), which must be done at
+//least every USB_HYBRID_POLL_PERIOD_MS.  Any transaction seen by a poll
+//switches the stack straight back to interrupt operation.
+#define USB_HYBRID_POLLING
+#define USB_HYBRID_POLL_PERIOD_MS   8               //1 to 9 ms, the USB stack must be serviced at least every 9.8 ms
+#define USB_HYBRID_IDLE_TIMEOUT     (uint8_t)50     //ms without bus activity before interrupts are dropped
+
 /* Parameter definitions are defined in usb_device.h */
 #define USB_PULLUP_OPTION USB_PULLUP_ENABLE
 //#define USB_PULLUP_OPTION USB_PULLUP_DISABLED
@@ -141,7 +152,7 @@
 
 #define USB_SUPPORT_DEVICE
 
-#define USB_NUM_STRING_DESCRIPTORS 3
+#define USB_NUM_STRING_DESCRIPTORS 4
 
 /*******************************************************************
  * Event disable options                                           
@@ -158,13 +169,44 @@
 //#define USB_DISABLE_SET_CONFIGURATION_HANDLER
 //#define USB_DISABLE_TRANSFER_COMPLETE_HANDLER 
 
+/*******************************************************************
+ * Transfer complete callback options
+ *   Enable this definition to allow functions registered with
+ *   USBSetTransferCompleteCallback() to be called from the USTAT
+ *   drain loop as each non-EP0 transaction completes.
+ *******************************************************************/
+#define USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS
+
+/*******************************************************************
+ * Transfer queue options
+ *   Enable this definition to allow several transfer requests to be
+ *   queued on a non-EP0 endpoint with USBQueueTransfer().  The stack
+ *   re-arms the endpoint from the queue, using both ping-pong BDT
+ *   entries where available, as each transaction completes.
+ *******************************************************************/
+#define USB_ENABLE_TRANSFER_QUEUES
+
+/*******************************************************************
+ * Statistics options
+ *   Enable this definition to have the stack keep saturating counts
+ *   of bus errors, stalls, resets and suspends plus per-endpoint
+ *   transaction counts (see USBGetStatistics()).  The application
+ *   can make them readable by the host by calling
+ *   USBCheckStatisticsRequest() on EVENT_EP0_REQUEST, which answers
+ *   the vendor device request USB_STATISTICS_VENDOR_REQUEST.
+ *******************************************************************/
+#define USB_ENABLE_STATISTICS
+#define USB_STATISTICS_VENDOR_REQUEST 0x01
+
 /** DEVICE CLASS USAGE *********************************************/
 #define USB_USE_CDC
 
 /** ENDPOINTS ALLOCATION *******************************************/
-#define USB_MAX_EP_NUMBER	    2
+#define USB_MAX_EP_NUMBER	    4
 
-/* CDC */
+/* CDC, two ACM functions grouped by interface association descriptors: the
+ * first is the data and log port and the second the command port, which has
+ * its own buffers and state, see CDC_CMD_PORT in usb_device_cdc.h */
 #define CDC_COMM_INTF_ID        0x0
 #define CDC_COMM_EP              1
 #define CDC_COMM_IN_EP_SIZE      10
@@ -174,8 +216,54 @@
 #define CDC_DATA_OUT_EP_SIZE    64
 #define CDC_DATA_IN_EP_SIZE     64
 
+#define CDC_CMD_COMM_INTF_ID    0x02
+#define CDC_CMD_COMM_EP         3
+#define CDC_CMD_COMM_IN_EP_SIZE 10
+
+#define CDC_CMD_DATA_INTF_ID    0x03
+#define CDC_CMD_DATA_EP         4
+#define CDC_CMD_DATA_OUT_EP_SIZE 16     //One request frame, see protocol.h
+#define CDC_CMD_DATA_IN_EP_SIZE 64
+//Size of the command port's receive ring buffer, behind readCmdUSBUSART(), up
+//to 255 bytes and at least CDC_CMD_DATA_OUT_EP_SIZE.  OUT packets are moved
+//into it as they complete, in the USB interrupt, and the buffer queued again
+//straight away.  Comment out to read from the endpoint buffer directly.
+#define USB_CDC_CMD_RX_RING_SIZE 64
+
+/* DFU, run-time mode only, see dfu.h; it uses EP0 alone.  Until there is a
+ * bootloader to detach to (WRT=BOOT over 0x000-0x1FF, the application linked
+ * above it) a detach only resets the unit and dfu-util waits for a DFU device
+ * that never comes, so the interface is left out of the configuration */
+//#define USB_DFU_RUNTIME
+#if defined(USB_DFU_RUNTIME)
+#define DFU_NUM_INT             1
+#else
+#define DFU_NUM_INT             0
+#endif
+#define DFU_INTF_ID             0x04
+//Milliseconds the host waits for us to drop off the bus after DFU_DETACH
+#define DFU_DETACH_TIMEOUT_MS   1000
+//Bytes per DFU_DNLOAD, for a bootloader: one row of flash, 32 words of 14 bits
+//in 2 bytes each.  The run-time descriptor doesn't offer download.
+#define DFU_TRANSFER_SIZE       64
+
 //#define USB_CDC_SET_LINE_CODING_HANDLER USART_mySetLineCodingHandler
 
+//Size of the transmit ring buffer behind writeUSBUSART(), up to 255 bytes.
+//Comment out to remove the ring buffer.
+#define USB_CDC_TX_RING_SIZE    128
+
+//Number of frames (ms) a part-filled packet of ring buffer data is held for,
+//counted from its first byte, so that later writeUSBUSART() calls can join it.
+//A full packet or flushUSBUSART() sends at once.  Needs USB_CDC_TX_RING_SIZE.
+//Comment out to send ring buffer data as soon as the transmit path is idle.
+#define USB_CDC_TX_COALESCE_FRAMES  4
+
+//Let the application report its own events to the host as SerialState
+//notifications on the CDC comm endpoint, see CDCSetSerialState().  Can't be
+//used with USB_CDC_SUPPORT_DSR_REPORTING, which reports a DSR pin instead.
+#define USB_CDC_SUPPORT_SERIAL_STATE_EVENTS
+
 //Define the logic level for the "active" state.  Setting is only relevant if
 //the respective function is enabled.  Allowed options are:
 //1 = active state logic level is Vdd
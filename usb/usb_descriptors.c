@@ -168,16 +168,16 @@ const USB_DEVICE_DESCRIPTOR device_dsc=
     0x12,                   // Size of this descriptor in bytes
     USB_DESCRIPTOR_DEVICE,  // DEVICE descriptor type
     0x0200,                 // USB Spec Release Number in BCD format
-    CDC_DEVICE,             // Class Code
-    0x00,                   // Subclass code
-    0x00,                   // Protocol code
+    0xEF,                   // Class Code: miscellaneous, the functions are
+    0x02,                   // Subclass code: common class, grouped by
+    0x01,                   // Protocol code: interface association descriptors
     USB_EP0_BUFF_SIZE,      // Max packet size for EP0, see usb_config.h
     0x04D8,                 // Vendor ID
     0x000A,                 // Product ID: CDC RS-232 Emulation Demo
     0x0100,                 // Device release number in BCD format
     0x01,                   // Manufacturer string index
     0x02,                   // Product string index
-    0x00,                   // Device serial number string index
+    0x03,                   // Device serial number string index
     0x01                    // Number of possible configurations
 };
 
@@ -186,13 +186,23 @@ const uint8_t configDescriptor1[]={
     /* Configuration Descriptor */
     0x09,//sizeof(USB_CFG_DSC),    // Size of this descriptor in bytes
     USB_DESCRIPTOR_CONFIGURATION,                // CONFIGURATION descriptor type
-    67,0,                   // Total length of data for this cfg
-    2,                      // Number of interfaces in this cfg
+    141 + 18 * DFU_NUM_INT,0,   // Total length of data for this cfg
+    USB_MAX_NUM_INT,        // Number of interfaces in this cfg
     1,                      // Index value of this configuration
     0,                      // Configuration string index
-    _DEFAULT | _SELF,               // Attributes, see usb_device.h
+    _DEFAULT | _SELF | _RWU,        // Attributes, see usb_device.h
     50,                     // Max power consumption (2X mA)
 							
+    /* Interface Association Descriptor: the data and log port */
+    0x08,                   // Size of this descriptor in bytes
+    0x0B,                   // INTERFACE ASSOCIATION descriptor type
+    CDC_COMM_INTF_ID,       // First interface of the function
+    2,                      // Number of interfaces in the function
+    COMM_INTF,              // Function class code
+    ABSTRACT_CONTROL_MODEL, // Function subclass code
+    V25TER,                 // Function protocol code
+    0,                      // Function string index
+
     /* Interface Descriptor */
     9,//sizeof(USB_INTF_DSC),   // Size of this descriptor in bytes
     USB_DESCRIPTOR_INTERFACE,               // INTERFACE descriptor type
@@ -264,6 +274,106 @@ const uint8_t configDescriptor1[]={
     _BULK,                       //Attributes
     0x40,0x00,                  //size
     0x00,                       //Interval
+
+    /* Interface Association Descriptor: the command port */
+    0x08,                   // Size of this descriptor in bytes
+    0x0B,                   // INTERFACE ASSOCIATION descriptor type
+    CDC_CMD_COMM_INTF_ID,   // First interface of the function
+    2,                      // Number of interfaces in the function
+    COMM_INTF,              // Function class code
+    ABSTRACT_CONTROL_MODEL, // Function subclass code
+    V25TER,                 // Function protocol code
+    0,                      // Function string index
+
+    /* Interface Descriptor */
+    9,//sizeof(USB_INTF_DSC),   // Size of this descriptor in bytes
+    USB_DESCRIPTOR_INTERFACE,               // INTERFACE descriptor type
+    CDC_CMD_COMM_INTF_ID,   // Interface Number
+    0,                      // Alternate Setting Number
+    1,                      // Number of endpoints in this intf
+    COMM_INTF,              // Class code
+    ABSTRACT_CONTROL_MODEL, // Subclass code
+    V25TER,                 // Protocol code
+    0,                      // Interface string index
+
+    /* CDC Class-Specific Descriptors */
+    sizeof(USB_CDC_HEADER_FN_DSC),
+    CS_INTERFACE,
+    DSC_FN_HEADER,
+    0x10,0x01,
+
+    sizeof(USB_CDC_ACM_FN_DSC),
+    CS_INTERFACE,
+    DSC_FN_ACM,
+    USB_CDC_ACM_FN_DSC_VAL,
+
+    sizeof(USB_CDC_UNION_FN_DSC),
+    CS_INTERFACE,
+    DSC_FN_UNION,
+    CDC_CMD_COMM_INTF_ID,
+    CDC_CMD_DATA_INTF_ID,
+
+    sizeof(USB_CDC_CALL_MGT_FN_DSC),
+    CS_INTERFACE,
+    DSC_FN_CALL_MGT,
+    0x00,
+    CDC_CMD_DATA_INTF_ID,
+
+    /* Endpoint Descriptor */
+    0x07,/*sizeof(USB_EP_DSC)*/
+    USB_DESCRIPTOR_ENDPOINT,    //Endpoint Descriptor
+    _EP03_IN,            //EndpointAddress
+    _INTERRUPT,                       //Attributes
+    0x08,0x00,                  //size
+    0x02,                       //Interval
+
+    /* Interface Descriptor */
+    9,//sizeof(USB_INTF_DSC),   // Size of this descriptor in bytes
+    USB_DESCRIPTOR_INTERFACE,               // INTERFACE descriptor type
+    CDC_CMD_DATA_INTF_ID,   // Interface Number
+    0,                      // Alternate Setting Number
+    2,                      // Number of endpoints in this intf
+    DATA_INTF,              // Class code
+    0,                      // Subclass code
+    NO_PROTOCOL,            // Protocol code
+    0,                      // Interface string index
+    
+    /* Endpoint Descriptor */
+    0x07,/*sizeof(USB_EP_DSC)*/
+    USB_DESCRIPTOR_ENDPOINT,    //Endpoint Descriptor
+    _EP04_OUT,            //EndpointAddress
+    _BULK,                       //Attributes
+    CDC_CMD_DATA_OUT_EP_SIZE,0x00,  //size
+    0x00,                       //Interval
+
+    /* Endpoint Descriptor */
+    0x07,/*sizeof(USB_EP_DSC)*/
+    USB_DESCRIPTOR_ENDPOINT,    //Endpoint Descriptor
+    _EP04_IN,            //EndpointAddress
+    _BULK,                       //Attributes
+    CDC_CMD_DATA_IN_EP_SIZE,0x00,   //size
+    0x00,                       //Interval
+
+#if defined(USB_DFU_RUNTIME)
+    /* Interface Descriptor */
+    9,//sizeof(USB_INTF_DSC),   // Size of this descriptor in bytes
+    USB_DESCRIPTOR_INTERFACE,               // INTERFACE descriptor type
+    DFU_INTF_ID,            // Interface Number
+    0,                      // Alternate Setting Number
+    0,                      // Number of endpoints in this intf
+    0xFE,                   // Class code: application specific
+    0x01,                   // Subclass code: device firmware upgrade
+    0x01,                   // Protocol code: run-time
+    0,                      // Interface string index
+
+    /* DFU Functional Descriptor */
+    9,                      // Size of this descriptor in bytes
+    0x21,                   // DFU FUNCTIONAL descriptor type
+    0x08,                   // Attributes: bitWillDetach; no bitCanDnload without a bootloader
+    (uint8_t)DFU_DETACH_TIMEOUT_MS,(uint8_t)(DFU_DETACH_TIMEOUT_MS >> 8),
+    (uint8_t)DFU_TRANSFER_SIZE,(uint8_t)(DFU_TRANSFER_SIZE >> 8),
+    0x10,0x01,              // DFU Spec Release Number in BCD format
+#endif
 };
 
 
@@ -285,6 +395,10 @@ sizeof(sd002),USB_DESCRIPTOR_STRING,
 'E','m','u','l','a','t','i','o','n',' ','D','e','m','o'}
 };
 
+//Serial number string descriptor, made at first boot and sent straight
+//from flash, see serial.h
+extern const uint8_t serialDescriptor[];
+
 //Array of configuration descriptors
 const uint8_t *const USB_CD_Ptr[]=
 {
@@ -295,7 +409,8 @@ const uint8_t *const USB_SD_Ptr[USB_NUM_STRING_DESCRIPTORS]=
 {
     (const uint8_t *const)&sd000,
     (const uint8_t *const)&sd001,
-    (const uint8_t *const)&sd002
+    (const uint8_t *const)&sd002,
+    (const uint8_t *const)serialDescriptor
 };
 
 #if defined(__18CXX)
@@ -155,6 +155,22 @@ volatile bool USBDeferINDataStagePackets;
 volatile bool USBDeferOUTDataStagePackets;
 USB_VOLATILE uint32_t USB1msTickCount;
 USB_VOLATILE uint8_t USBTicksSinceSuspendEnd;
+#if defined(USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS)
+USB_TRANSFER_COMPLETE_CALLBACK pTransferCompleteCallbackOut[USB_MAX_EP_NUMBER+1];
+USB_TRANSFER_COMPLETE_CALLBACK pTransferCompleteCallbackIn[USB_MAX_EP_NUMBER+1];
+#endif
+#if defined(USB_ENABLE_TRANSFER_QUEUES)
+USB_TRANSFER_QUEUE transferQueueOut[USB_MAX_EP_NUMBER+1];
+USB_TRANSFER_QUEUE transferQueueIn[USB_MAX_EP_NUMBER+1];
+#endif
+#if defined(USB_HYBRID_POLLING)
+USB_VOLATILE bool USBHybridInterruptMode;
+USB_VOLATILE uint8_t USBHybridIdleCounter;
+USB_VOLATILE uint16_t USBHybridLastFrame;
+#endif
+#if defined(USB_ENABLE_STATISTICS)
+USB_VOLATILE USB_STATISTICS USBStatistics;
+#endif
 
 /** USB FIXED LOCATION VARIABLES ***********************************/
 #if defined(COMPILER_MPLAB_C18)
@@ -234,6 +250,14 @@ static void USBConfigureEndpoint(uint8_t EPNum, uint8_t direction);
 static void USBWakeFromSuspend(void);
 static void USBSuspend(void);
 static void USBStallHandler(void);
+#if defined(USB_ENABLE_TRANSFER_QUEUES)
+static void USBTransferQueueArm(uint8_t ep, uint8_t dir);
+static void USBTransferQueueComplete(uint8_t ep, uint8_t dir, uint8_t count);
+static void USBTransferQueueFlush(uint8_t ep, uint8_t dir, bool notify);
+#endif
+#if defined(USB_HYBRID_POLLING)
+static void USBHybridFrameTicks(void);
+#endif
 
 // *****************************************************************************
 // *****************************************************************************
@@ -357,6 +381,8 @@ void USBDeviceInit(void)
     USBDeferINDataStagePackets = false;
     USBDeferOUTDataStagePackets = false;
     USBBusIsSuspended = false;
+    //A bus reset disables remote wakeup until the host enables it again.
+    RemoteWakeup = false;
 
     //Initialize all pBDTEntryIn[] and pBDTEntryOut[]
     //pointers to NULL, so they don't get used inadvertently.
@@ -366,6 +392,14 @@ void USBDeviceInit(void)
         pBDTEntryOut[i] = 0u;
         ep_data_in[i].Val = 0u;
         ep_data_out[i].Val = 0u;
+        #if defined(USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS)
+        pTransferCompleteCallbackIn[i] = NULL;
+        pTransferCompleteCallbackOut[i] = NULL;
+        #endif
+        #if defined(USB_ENABLE_TRANSFER_QUEUES)
+        USBTransferQueueFlush(i, OUT_FROM_HOST, false);
+        USBTransferQueueFlush(i, IN_TO_HOST, false);
+        #endif
     }
 
     //Get ready for the first packet
@@ -384,6 +418,12 @@ void USBDeviceInit(void)
     USB1msTickCount = 0;            //Keeps track of total number of milliseconds since calling USBDeviceInit() when first initializing the USB module/stack code.
     USBTicksSinceSuspendEnd = 0;    //Keeps track of the number of milliseconds since a suspend condition has ended.
 
+    #if defined(USB_HYBRID_POLLING)
+    //Start out interrupt driven; enumeration is about to happen
+    USBHybridActivity();
+    USBHybridLastFrame = 0xFFFF;    //No valid frame number yet
+    #endif
+
     //Indicate that we are now in the detached state
     USBDeviceState = DETACHED_STATE;
 }
@@ -680,6 +720,7 @@ void USBDeviceTasks(void)
      */
     if(USBResetIF && USBResetIE)
     {
+        USBStatisticsIncrement(USBStatistics.resets);
         USBDeviceInit();
 
         //Re-enable the interrupts since the USBDeviceInit() function will
@@ -733,7 +774,31 @@ void USBDeviceTasks(void)
         USBClearInterruptFlag(USBSOFIFReg,USBSOFIFBitNum);
 
         #if defined(__XC8__) || defined(__C18__)
-            USBIncrement1msInternalTimers();
+            #if defined(USB_HYBRID_POLLING)
+                //May be more than one frame since the last SOF was seen
+                USBHybridFrameTicks();
+            #else
+                USBIncrement1msInternalTimers();
+            #endif
+        #endif
+
+        #if defined(USB_HYBRID_POLLING)
+            //Once the bus has been quiet for long enough, with no control
+            //transfer in progress, stop taking USB interrupts; from now on
+            //the stack is serviced by the application calling USBHybridPoll().
+            if(USBHybridInterruptMode)
+            {
+                if(USBHybridIdleCounter != 0u)
+                {
+                    USBHybridIdleCounter--;
+                }
+                if((USBHybridIdleCounter == 0u) && (controlTransferState == WAIT_SETUP) &&
+                   (USBDeviceState == CONFIGURED_STATE))
+                {
+                    USBHybridInterruptMode = false;
+                    USBMaskInterrupts();
+                }
+            }
         #endif
 
         #if defined(USB_ENABLE_STATUS_STAGE_TIMEOUTS)
@@ -773,6 +838,25 @@ void USBDeviceTasks(void)
 
     if(USBErrorIF && USBErrorIE)
     {
+        #if defined(USB_ENABLE_STATISTICS)
+        {
+            //Note which errors occurred before the flags get cleared
+            uint8_t errors = U1EIR;
+
+            if(errors & USB_ERROR_PID_MASK)
+                USBStatisticsIncrement(USBStatistics.pidErrors);
+            if(errors & USB_ERROR_CRC5_MASK)
+                USBStatisticsIncrement(USBStatistics.crc5Errors);
+            if(errors & USB_ERROR_CRC16_MASK)
+                USBStatisticsIncrement(USBStatistics.crc16Errors);
+            if(errors & USB_ERROR_DFN8_MASK)
+                USBStatisticsIncrement(USBStatistics.dataFieldSizeErrors);
+            if(errors & USB_ERROR_BTO_MASK)
+                USBStatisticsIncrement(USBStatistics.busTimeoutErrors);
+            if(errors & USB_ERROR_BTS_MASK)
+                USBStatisticsIncrement(USBStatistics.bitStuffErrors);
+        }
+        #endif
         USB_ERROR_HANDLER(EVENT_BUS_ERROR,0,1);
         USBClearInterruptRegister(U1EIR);               // This clears UERRIF
 
@@ -810,6 +894,9 @@ void USBDeviceTasks(void)
 
                 USBClearInterruptFlag(USBTransactionCompleteIFReg,USBTransactionCompleteIFBitNum);
 
+                //The bus is busy, stay interrupt driven for now
+                USBHybridActivity();
+
                 //Keep track of the hardware ping pong state for endpoints other
                 //than EP0, if ping pong buffering is enabled.
                 #if (USB_PING_PONG_MODE == USB_PING_PONG__ALL_BUT_EP0) || (USB_PING_PONG_MODE == USB_PING_PONG__FULL_PING_PONG)
@@ -823,6 +910,17 @@ void USBDeviceTasks(void)
                 }
                 #endif
 
+                #if defined(USB_ENABLE_STATISTICS)
+                if(USBHALGetLastDirection(USTATcopy) == OUT_FROM_HOST)
+                {
+                    USBStatistics.outTransactions[endpoint_number]++;
+                }
+                else
+                {
+                    USBStatistics.inTransactions[endpoint_number]++;
+                }
+                #endif
+
                 //USBCtrlEPService only services transactions over EP0.
                 //It ignores all other EP transactions.
                 if(endpoint_number == 0)
@@ -831,6 +929,44 @@ void USBDeviceTasks(void)
                 }
                 else
                 {
+                    #if defined(USB_ENABLE_TRANSFER_QUEUES) || defined(USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS)
+                    {
+                        //Find the BDT entry that just completed and take the
+                        //number of bytes actually transferred from it now,
+                        //before anything gets the chance to re-arm it.
+                        volatile BDT_ENTRY *pBDTEntry;
+                        uint8_t count;
+                        #if defined(USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS)
+                        USB_TRANSFER_COMPLETE_CALLBACK callback;
+                        #endif
+
+                        pBDTEntry = (volatile BDT_ENTRY*)&BDT[EP(endpoint_number, USBHALGetLastDirection(USTATcopy), USBHALGetLastPingPong(USTATcopy))];
+                        count = pBDTEntry->CNT;
+
+                        #if defined(USB_ENABLE_TRANSFER_QUEUES)
+                        //Retire the oldest request queued on the endpoint (if it
+                        //is being used through the queue) and re-arm from the queue.
+                        USBTransferQueueComplete(endpoint_number, USBHALGetLastDirection(USTATcopy), count);
+                        #endif
+
+                        #if defined(USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS)
+                        //Then hand the completed BDT entry to the function (if
+                        //any) registered for this endpoint and direction.
+                        if(USBHALGetLastDirection(USTATcopy) == OUT_FROM_HOST)
+                        {
+                            callback = pTransferCompleteCallbackOut[endpoint_number];
+                        }
+                        else
+                        {
+                            callback = pTransferCompleteCallbackIn[endpoint_number];
+                        }
+                        if(callback != NULL)
+                        {
+                            callback((USB_HANDLE)pBDTEntry, count);
+                        }
+                        #endif
+                    }
+                    #endif
                     USB_TRANSFER_COMPLETE_HANDLER(EVENT_TRANSFER, (uint8_t*)&USTATcopy.Val, 0);
                 }
             }//end if(USBTransactionCompleteIF)
@@ -1043,6 +1179,10 @@ USB_HANDLE USBTransferOnePacket(uint8_t ep,uint8_t dir,uint8_t* data,uint8_t len
         }
     #endif
 
+    //Expect the host to come for this soon; the USB interrupt is unmasked
+    //again when the caller (or the next USBHybridPoll()) unmasks interrupts
+    USBHybridActivity();
+
     //Set the data pointer, data length, and enable the endpoint
     handle->ADR = ConvertToPhysicalAddress(data);
     handle->CNT = len;
@@ -1166,6 +1306,133 @@ void USBCancelIO(uint8_t endpoint)
     }
 }
 
+#if defined(USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS)
+/**************************************************************************
+    Function:
+        void USBSetTransferCompleteCallback(uint8_t ep, uint8_t dir, USB_TRANSFER_COMPLETE_CALLBACK callback)
+
+    Summary:
+        Registers a function to be called as soon as a transaction completes
+        on the specified non-EP0 endpoint and direction.
+
+    Description:
+        Registers a function to be called as soon as a transaction completes
+        on the specified non-EP0 endpoint and direction.  The function is
+        called from the USTAT drain loop in USBDeviceTasks(), before
+        EVENT_TRANSFER is thrown, and is passed the handle of the BDT entry
+        that completed and the number of bytes actually transferred.
+
+    Precondition:
+        The endpoint should have been enabled with USBEnableEndpoint().
+
+    Parameters:
+        uint8_t ep - the endpoint number (1 to USB_MAX_EP_NUMBER).
+        uint8_t dir - the direction, either IN_TO_HOST or OUT_FROM_HOST.
+        USB_TRANSFER_COMPLETE_CALLBACK callback - the function to call, or
+                  NULL to stop calling a previously registered function.
+
+    Return Values:
+        None
+
+    Remarks:
+        All callbacks are removed by USBDeviceInit() and whenever the host
+        sets the configuration, so they should be registered from the
+        EVENT_CONFIGURED handler, alongside USBEnableEndpoint().
+  **************************************************************************/
+void USBSetTransferCompleteCallback(uint8_t ep, uint8_t dir, USB_TRANSFER_COMPLETE_CALLBACK callback)
+{
+    if((ep == 0u) || (ep > USB_MAX_EP_NUMBER))
+    {
+        return;
+    }
+
+    //The callback tables are read by USBDeviceTasks(), which may be running
+    //from the interrupt context.
+    USBMaskInterrupts();
+    if(dir == OUT_FROM_HOST)
+    {
+        pTransferCompleteCallbackOut[ep] = callback;
+    }
+    else
+    {
+        pTransferCompleteCallbackIn[ep] = callback;
+    }
+    USBUnmaskInterrupts();
+}
+#endif
+
+#if defined(USB_ENABLE_TRANSFER_QUEUES)
+/**************************************************************************
+    Function:
+        bool USBQueueTransfer(uint8_t ep, uint8_t dir, USB_TRANSFER_REQUEST *pRequest)
+
+    Summary:
+        Adds a transfer request to the queue of the specified non-EP0
+        endpoint and direction.
+
+    Description:
+        Adds a transfer request to the queue of the specified non-EP0
+        endpoint and direction.  The request is handed to the SIE as soon as
+        a BDT entry is free and, as each transaction completes, the stack
+        re-arms the endpoint from the queue itself (see
+        USBTransferQueueComplete()).
+
+    Precondition:
+        The endpoint must have been enabled with USBEnableEndpoint().
+
+    Parameters:
+        uint8_t ep - the endpoint number (1 to USB_MAX_EP_NUMBER).
+        uint8_t dir - the direction, either IN_TO_HOST or OUT_FROM_HOST.
+        USB_TRANSFER_REQUEST *pRequest - the request, with pData, len and
+                  pFunc filled in.
+
+    Return Values:
+        true - the request was queued.
+        false - the endpoint is invalid or the request is already busy.
+
+    Remarks:
+        None
+  **************************************************************************/
+bool USBQueueTransfer(uint8_t ep, uint8_t dir, USB_TRANSFER_REQUEST *pRequest)
+{
+    USB_TRANSFER_QUEUE *pQueue;
+
+    if((ep == 0u) || (ep > USB_MAX_EP_NUMBER) || USBTransferRequestBusy(pRequest))
+    {
+        return false;
+    }
+
+    if(dir == OUT_FROM_HOST)
+    {
+        pQueue = &transferQueueOut[ep];
+    }
+    else
+    {
+        pQueue = &transferQueueIn[ep];
+    }
+
+    pRequest->pNext = NULL;
+    pRequest->status = USB_TRANSFER_REQUEST_QUEUED;
+
+    //The queue is also modified by USBDeviceTasks(), which may be running
+    //from the interrupt context.
+    USBMaskInterrupts();
+    if(pQueue->pTail == NULL)
+    {
+        pQueue->pHead = pRequest;
+    }
+    else
+    {
+        pQueue->pTail->pNext = pRequest;
+    }
+    pQueue->pTail = pRequest;
+    USBTransferQueueArm(ep, dir);
+    USBUnmaskInterrupts();
+
+    return true;
+}
+#endif
+
 /**************************************************************************
     Function:
         void USBDeviceDetach(void)
@@ -2006,6 +2273,17 @@ static void USBStdSetCfgHandler(void)
 	{
 		ep_data_in[i].Val = 0u;
         ep_data_out[i].Val = 0u;
+        #if defined(USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS)
+        //Endpoints are about to be reconfigured, drop any old callbacks.  The
+        //EVENT_CONFIGURED handler re-registers the ones it wants.
+        pTransferCompleteCallbackIn[i] = NULL;
+        pTransferCompleteCallbackOut[i] = NULL;
+        #endif
+        #if defined(USB_ENABLE_TRANSFER_QUEUES)
+        //The BDT has just been cleared, so nothing queued can complete now
+        USBTransferQueueFlush(i, OUT_FROM_HOST, false);
+        USBTransferQueueFlush(i, IN_TO_HOST, false);
+        #endif
 	}
 
     //clear the alternate interface settings
@@ -2229,6 +2507,8 @@ static void USBStallHandler(void)
      * for EP0_IN will then be forced back to CPU by firmware.
      */
 
+    USBStatisticsIncrement(USBStatistics.stalls);
+
     if(U1EP0bits.EPSTALL == 1)
     {
         // UOWN - if 0, owned by CPU, if 1, owned by SIE
@@ -2288,6 +2568,12 @@ static void USBSuspend(void)
     USBActivityIE = 1;                     // Enable bus activity interrupt
     USBClearInterruptFlag(USBIdleIFReg,USBIdleIFBitNum);
 
+    //The activity interrupt must be able to wake the device from sleep, so
+    //go back to being interrupt driven (there are no SOFs while suspended).
+    USBHybridActivity();
+
+    USBStatisticsIncrement(USBStatistics.suspends);
+
     #if defined(__18CXX) || defined(_PIC14E) || defined(__XC8)
         U1CONbits.SUSPND = 1;                   // Put USB module in power conserve
                                                 // mode, SIE clock inactive
@@ -2322,6 +2608,13 @@ static void USBWakeFromSuspend(void)
 {
     USBBusIsSuspended = false;
 
+    #if defined(USB_HYBRID_POLLING)
+    //The frame number has moved on while we were suspended, which isn't
+    //time that USBGet1msTickCount() should count.
+    USBHybridActivity();
+    USBHybridLastFrame = 0xFFFF;
+    #endif
+
     /*
      * If using clock switching, the place to restore the original
      * microcontroller core clock frequency is in the USBCBWakeFromSuspend() callback
@@ -2904,6 +3197,7 @@ static void USBStdFeatureReqHandler(void)
                     //the application firmware uses USBTransferOnePacket() on the EP.
                     p->STAT.Val &= (~_USIE);    //Clear UOWN bit
                     p->STAT.Val |= _DAT1;       //Set DTS to DATA1
+                    USBStatisticsIncrement(USBStatistics.terminatedTransfers);
                     USB_TRANSFER_TERMINATED_HANDLER(EVENT_TRANSFER_TERMINATED,p,sizeof(p));
                 }
                 else
@@ -2934,6 +3228,7 @@ static void USBStdFeatureReqHandler(void)
                     p->STAT.Val &= ~(_USIE | _DAT1 | _BSTALL);  
                     //Call the application event handler callback function, so it can 
 					//decide if the endpoint should get re-armed again or not.
+                    USBStatisticsIncrement(USBStatistics.terminatedTransfers);
                     USB_TRANSFER_TERMINATED_HANDLER(EVENT_TRANSFER_TERMINATED,p,sizeof(p));
                 }
                 else
@@ -2969,6 +3264,7 @@ static void USBStdFeatureReqHandler(void)
                     //Let the application firmware know a transaction just
                     //got terminated by the host, and that it is now free to
                     //re-arm the endpoint or do other tasks if desired.                                        
+                    USBStatisticsIncrement(USBStatistics.terminatedTransfers);
                     USB_TRANSFER_TERMINATED_HANDLER(EVENT_TRANSFER_TERMINATED,p,sizeof(p));
                 }
                 else
@@ -2992,6 +3288,12 @@ static void USBStdFeatureReqHandler(void)
 
 			//Clear the STALL bit in the UEP register
             *pUEP &= ~UEP_STALL;            
+
+            #if defined(USB_ENABLE_TRANSFER_QUEUES)
+            //Anything queued on the endpoint has now been terminated.  Hand the
+            //requests back so the application can decide whether to re-queue them.
+            USBTransferQueueFlush(SetupPkt.EPNum, SetupPkt.EPDir, true);
+            #endif
         }//end if(SetupPkt.bRequest == USB_REQUEST_SET_FEATURE)
     }//end if (lots of checks for set/clear endpoint halt)
 }//end USBStdFeatureReqHandler
@@ -3138,6 +3440,422 @@ uint32_t USBGet1msTickCount(void)
     #endif
 }
 
+/**************************************************************************
+    Function:
+        bool USBCBSendResume(void)
+
+    Summary:
+        Wakes the host by driving resume signalling onto a suspended bus.
+
+    Description:
+        If the host has enabled remote wakeup and the bus is suspended this
+        function brings the USB module out of suspend, waits for the bus to
+        have been idle for the required 5ms, then drives resume (K state)
+        signalling for the specified 1 to 15ms.  The host then resumes the
+        bus itself and normal traffic, including SOFs, starts again.
+
+    PreCondition:
+        None
+
+    Parameters:
+        None
+
+    Return Values:
+        true - resume signalling was sent.
+        false - remote wakeup isn't enabled or the bus isn't suspended.
+
+    Remarks:
+        This function blocks, with USB interrupts masked, for about 15ms.
+        The configuration descriptor must have the _RWU attribute set for
+        the host to enable remote wakeup.
+  **************************************************************************/
+bool USBCBSendResume(void)
+{
+    uint8_t i;
+
+    if((USBGetRemoteWakeupStatus() == false) || (USBIsBusSuspended() == false))
+    {
+        return false;
+    }
+
+    USBMaskInterrupts();
+
+    //Restore the clocks and bring the SIE out of power conserve mode
+    USBWakeFromSuspend();
+
+    //The bus must be idle for at least 5ms before the device may signal
+    //resume (USB 2.0 section 7.1.7.7).  Allow a little margin.
+    for(i = 0; i < 6; i++)
+    {
+        USBHALDelay1ms();
+    }
+
+    //Drive resume signalling for between 1 and 15ms.
+    USBResumeControl = 1;
+    for(i = 0; i < 10; i++)
+    {
+        USBHALDelay1ms();
+    }
+    USBResumeControl = 0;
+
+    USBUnmaskInterrupts();
+
+    return true;
+}
+
+#if defined(USB_ENABLE_STATISTICS)
+/**************************************************************************
+    Function:
+        void USBClearStatistics(void)
+
+    Summary:
+        Zeroes the statistics kept by the stack.
+
+    PreCondition:
+        None
+
+    Parameters:
+        None
+
+    Return Values:
+        None
+
+    Remarks:
+        Only available when USB_ENABLE_STATISTICS is defined in usb_config.h.
+  **************************************************************************/
+void USBClearStatistics(void)
+{
+    uint8_t i;
+    uint8_t *pByte = (uint8_t *)&USBStatistics;
+
+    //The stack updates the counters from USBDeviceTasks()
+    USBMaskInterrupts();
+    for(i = 0; i < sizeof(USBStatistics); i++)
+    {
+        *pByte = 0;
+        pByte++;
+    }
+    USBUnmaskInterrupts();
+}
+
+/**************************************************************************
+    Function:
+        void USBCheckStatisticsRequest(void)
+
+    Summary:
+        Handles the vendor request that reads or clears the statistics.
+
+    Description:
+        Should be called from the EVENT_EP0_REQUEST handler.  A device to
+        host vendor request to the device with bRequest equal to
+        USB_STATISTICS_VENDOR_REQUEST returns the USB_STATISTICS structure,
+        a host to device one clears it.  Other requests are ignored.
+
+    PreCondition:
+        None
+
+    Parameters:
+        None
+
+    Return Values:
+        None
+
+    Remarks:
+        Only available when USB_ENABLE_STATISTICS is defined in usb_config.h.
+  **************************************************************************/
+void USBCheckStatisticsRequest(void)
+{
+    if((SetupPkt.RequestType != USB_SETUP_TYPE_VENDOR_BITFIELD) ||
+       (SetupPkt.Recipient != USB_SETUP_RECIPIENT_DEVICE_BITFIELD) ||
+       (SetupPkt.bRequest != USB_STATISTICS_VENDOR_REQUEST))
+    {
+        return;
+    }
+
+    if(SetupPkt.DataDir == USB_SETUP_DEVICE_TO_HOST_BITFIELD)
+    {
+        //Sent straight from RAM; this runs in the same context as the code
+        //that updates the counters, so no counter changes part way through
+        //being copied into the EP0 buffer.
+        USBEP0SendRAMPtr((uint8_t*)&USBStatistics, sizeof(USBStatistics), USB_EP0_INCLUDE_ZERO);
+    }
+    else if(SetupPkt.wLength == 0)
+    {
+        USBClearStatistics();
+        USBEP0Transmit(USB_EP0_NO_DATA);
+    }
+}
+#endif
+
+#if defined(USB_HYBRID_POLLING)
+/**************************************************************************
+    Function:
+        void USBHybridPoll(void)
+
+    Summary:
+        Services the USB stack while it is in the polled phase of hybrid
+        polling operation.
+
+    Description:
+        Should be called by the application every USB_HYBRID_POLL_PERIOD_MS.
+        While the stack is idle the USB interrupt is masked; this function
+        briefly unmasks it so that, if anything is pending, USBDeviceTasks()
+        runs straight away from the interrupt context.  USBDeviceTasks() will
+        itself switch back to interrupt operation if it finds the bus busy.
+
+    PreCondition:
+        None
+
+    Parameters:
+        None
+
+    Return Values:
+        None
+
+    Remarks:
+        Only available when USB_HYBRID_POLLING is defined in usb_config.h.
+  **************************************************************************/
+void USBHybridPoll(void)
+{
+    //Give any pending USB interrupt the chance to be taken now
+    USBForceUnmaskInterrupts();
+    NOP();
+
+    //Then leave the interrupt unmasked only if the stack is (now) interrupt
+    //driven.  If the interrupt happened to go active between the test and
+    //the write the next poll will put things right.
+    USBUnmaskInterrupts();
+}
+#endif
+
+#if defined(USB_ENABLE_TRANSFER_QUEUES)
+/********************************************************************
+ * Function:        void USBTransferQueueArm(uint8_t ep, uint8_t dir)
+ *
+ * PreCondition:    None
+ *
+ * Input:           uint8_t ep - the endpoint number
+ *                  uint8_t dir - IN_TO_HOST or OUT_FROM_HOST
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Hands queued requests to the SIE until either the
+ *                  queue has nothing left that isn't already armed or
+ *                  every BDT entry of the endpoint is in use.
+ *
+ * Note:            Must be called with USB interrupts masked, or from
+ *                  within USBDeviceTasks().
+ *******************************************************************/
+static void USBTransferQueueArm(uint8_t ep, uint8_t dir)
+{
+    USB_TRANSFER_QUEUE *pQueue;
+    USB_TRANSFER_REQUEST *pRequest;
+    uint8_t i;
+
+    if(dir == OUT_FROM_HOST)
+    {
+        pQueue = &transferQueueOut[ep];
+    }
+    else
+    {
+        pQueue = &transferQueueIn[ep];
+    }
+
+    //Skip over the requests that the SIE already owns; they are always
+    //the oldest ones, at the head of the queue.
+    pRequest = pQueue->pHead;
+    for(i = 0; (i < pQueue->armed) && (pRequest != NULL); i++)
+    {
+        pRequest = pRequest->pNext;
+    }
+
+    while((pRequest != NULL) && (pQueue->armed < USB_TRANSFER_QUEUE_MAX_ARMED))
+    {
+        //Don't tread on a BDT entry that has been armed some other way
+        if(USBHandleBusy(USBGetNextHandle(ep, dir)))
+        {
+            break;
+        }
+        if(USBTransferOnePacket(ep, dir, pRequest->pData, pRequest->len) == 0)
+        {
+            //The endpoint hasn't been enabled
+            break;
+        }
+        pRequest->status = USB_TRANSFER_REQUEST_ACTIVE;
+        pQueue->armed++;
+        pRequest = pRequest->pNext;
+    }
+}
+
+/********************************************************************
+ * Function:        void USBTransferQueueComplete(uint8_t ep,
+ *                                                uint8_t dir,
+ *                                                uint8_t count)
+ *
+ * PreCondition:    None
+ *
+ * Input:           uint8_t ep - the endpoint number
+ *                  uint8_t dir - IN_TO_HOST or OUT_FROM_HOST
+ *                  uint8_t count - the byte count from the BDT entry
+ *                                  that has just completed
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Called from the USTAT drain loop in USBDeviceTasks()
+ *                  when a transaction completes on a non-EP0 endpoint.
+ *                  BDT entries complete in the order they were armed, so
+ *                  the completed transaction belongs to the request at
+ *                  the head of the queue.  That request is retired, the
+ *                  freed BDT entry is re-armed from the queue and then
+ *                  the request's pFunc is called.
+ *
+ * Note:            Does nothing if the endpoint isn't being used through
+ *                  the queue.
+ *******************************************************************/
+static void USBTransferQueueComplete(uint8_t ep, uint8_t dir, uint8_t count)
+{
+    USB_TRANSFER_QUEUE *pQueue;
+    USB_TRANSFER_REQUEST *pRequest;
+
+    if(dir == OUT_FROM_HOST)
+    {
+        pQueue = &transferQueueOut[ep];
+    }
+    else
+    {
+        pQueue = &transferQueueIn[ep];
+    }
+
+    pRequest = pQueue->pHead;
+    if((pRequest == NULL) || (pQueue->armed == 0u))
+    {
+        return;
+    }
+
+    pQueue->pHead = pRequest->pNext;
+    if(pQueue->pHead == NULL)
+    {
+        pQueue->pTail = NULL;
+    }
+    pQueue->armed--;
+
+    pRequest->len = count;
+    pRequest->status = USB_TRANSFER_REQUEST_COMPLETE;
+
+    //Re-arm before calling back so that the SIE has the next buffer as
+    //early as possible.
+    USBTransferQueueArm(ep, dir);
+
+    if(pRequest->pFunc != NULL)
+    {
+        pRequest->pFunc(pRequest);
+    }
+}
+
+/********************************************************************
+ * Function:        void USBTransferQueueFlush(uint8_t ep,
+ *                                             uint8_t dir,
+ *                                             bool notify)
+ *
+ * PreCondition:    None
+ *
+ * Input:           uint8_t ep - the endpoint number
+ *                  uint8_t dir - IN_TO_HOST or OUT_FROM_HOST
+ *                  bool notify - true if the pFunc of each request should
+ *                                be called
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Empties the queue of an endpoint, marking every request
+ *                  in it as USB_TRANSFER_REQUEST_TERMINATED.  The BDT
+ *                  entries themselves are dealt with by the caller.
+ *
+ * Note:            None
+ *******************************************************************/
+static void USBTransferQueueFlush(uint8_t ep, uint8_t dir, bool notify)
+{
+    USB_TRANSFER_QUEUE *pQueue;
+    USB_TRANSFER_REQUEST *pRequest;
+    USB_TRANSFER_REQUEST *pNext;
+
+    if(dir == OUT_FROM_HOST)
+    {
+        pQueue = &transferQueueOut[ep];
+    }
+    else
+    {
+        pQueue = &transferQueueIn[ep];
+    }
+
+    pRequest = pQueue->pHead;
+    pQueue->pHead = NULL;
+    pQueue->pTail = NULL;
+    pQueue->armed = 0;
+
+    while(pRequest != NULL)
+    {
+        pNext = pRequest->pNext;
+        pRequest->status = USB_TRANSFER_REQUEST_TERMINATED;
+        if(notify && (pRequest->pFunc != NULL))
+        {
+            pRequest->pFunc(pRequest);
+        }
+        pRequest = pNext;
+    }
+}
+#endif
+
+#if defined(USB_HYBRID_POLLING)
+/********************************************************************
+ * Function:        void USBHybridFrameTicks(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Called on start of frame in place of
+ *                  USBIncrement1msInternalTimers().  When polled the
+ *                  stack may only see one SOF in every few, so the
+ *                  number of 1ms frames that have actually elapsed is
+ *                  worked out from the 11 bit USB frame number.
+ *
+ * Note:            None
+ *******************************************************************/
+static void USBHybridFrameTicks(void)
+{
+    uint16_t frame;
+    uint16_t elapsed;
+
+    frame = USBHALGetFrameNumber();
+    if(USBHybridLastFrame > 0x7FF)
+    {
+        //First SOF since reset or resume
+        elapsed = 1;
+    }
+    else
+    {
+        elapsed = (frame - USBHybridLastFrame) & 0x7FF;
+    }
+    USBHybridLastFrame = frame;
+
+    while(elapsed != 0u)
+    {
+        USBIncrement1msInternalTimers();
+        elapsed--;
+    }
+}
+#endif
+
 
 
 
@@ -61,6 +61,48 @@ please contact mla_licensing@microchip.com
 #define USB_EP0_NO_DATA        0x00     //no data to send
 #define USB_EP0_NO_OPTIONS     0x00     //no options set
 
+//Function called when a transaction completes on a non-EP0 endpoint; it is
+//passed the handle of the BDT entry that completed and the byte count.
+typedef void (*USB_TRANSFER_COMPLETE_CALLBACK)(USB_HANDLE handle, uint16_t size);
+
+//Values of the status field of a USB_TRANSFER_REQUEST
+#define USB_TRANSFER_REQUEST_IDLE        0x00  //Never been queued
+#define USB_TRANSFER_REQUEST_COMPLETE    0x01  //Transaction completed, len holds the actual byte count
+#define USB_TRANSFER_REQUEST_TERMINATED  0x02  //Removed from the queue by a reset, set configuration or clear halt
+#define USB_TRANSFER_REQUEST_QUEUED      0x03  //Waiting for a free BDT entry
+#define USB_TRANSFER_REQUEST_ACTIVE      0x04  //Owned by the SIE
+
+//A transfer request, for use with USBQueueTransfer().  The request and its
+//  data buffer belong to the caller and must stay in scope until the request
+//  is no longer busy (see USBTransferRequestBusy()).
+typedef struct _USB_TRANSFER_REQUEST
+{
+    uint8_t *pData;                                        //Buffer in USB module accessible RAM
+    uint8_t len;                                           //Bytes to send/buffer size; actual byte count on completion
+    volatile uint8_t status;                               //One of USB_TRANSFER_REQUEST_xxx
+    void (*pFunc)(struct _USB_TRANSFER_REQUEST *pRequest); //Called on completion or termination, may be NULL
+    struct _USB_TRANSFER_REQUEST *pNext;                   //Used by the stack
+} USB_TRANSFER_REQUEST;
+
+//Statistics kept by the stack when USB_ENABLE_STATISTICS is defined, see
+//  USBGetStatistics().  The error and event counts stop at 0xFFFF, the
+//  transaction counts wrap.
+typedef struct
+{
+    uint16_t pidErrors;                                    //PID check failures
+    uint16_t crc5Errors;                                   //Token packet CRC5 failures
+    uint16_t crc16Errors;                                  //Data packet CRC16 failures
+    uint16_t dataFieldSizeErrors;                          //Data fields that weren't a whole number of bytes
+    uint16_t busTimeoutErrors;                             //Bus turnaround timeouts
+    uint16_t bitStuffErrors;                               //Bit stuffing errors
+    uint16_t stalls;                                       //STALL handshakes sent
+    uint16_t resets;                                       //Bus resets
+    uint16_t suspends;                                     //Bus suspends
+    uint16_t terminatedTransfers;                          //Transactions terminated by a clear endpoint halt
+    uint32_t outTransactions[USB_MAX_EP_NUMBER+1];         //Completed OUT (and SETUP) transactions per endpoint
+    uint32_t inTransactions[USB_MAX_EP_NUMBER+1];          //Completed IN transactions per endpoint
+} USB_STATISTICS;
+
 /********************************************************************
  * Standard Request Codes
  * USB 2.0 Spec Ref Table 9-4
@@ -491,6 +533,151 @@ void USBStallEndpoint(uint8_t ep, uint8_t dir);
   **************************************************************************/
 void USBCancelIO(uint8_t endpoint);
 
+/**************************************************************************
+    Function:
+        void USBSetTransferCompleteCallback(uint8_t ep, uint8_t dir, USB_TRANSFER_COMPLETE_CALLBACK callback)
+
+    Summary:
+        Registers a function to be called as soon as a transaction completes
+        on the specified non-EP0 endpoint and direction.
+
+    Description:
+        Registers a function to be called as soon as a transaction completes
+        on the specified non-EP0 endpoint and direction.  This lets received
+        data be consumed, or the next IN packet be armed, without polling
+        USBHandleBusy() from the main loop.  The function is called from the
+        USTAT drain loop in USBDeviceTasks(), before EVENT_TRANSFER is thrown,
+        and is passed the handle of the BDT entry that completed and the
+        number of bytes actually transferred.
+
+        Typical Usage:
+        <code>
+        static void DataOutComplete(USB_HANDLE handle, uint16_t size)
+        {
+            //Consume size bytes from USBHandleGetAddr(handle) then re-arm
+            //the endpoint with USBRxOnePacket()
+        }
+
+        //From the EVENT_CONFIGURED handler
+        USBEnableEndpoint(DATA_EP, USB_OUT_ENABLED|USB_HANDSHAKE_ENABLED|USB_DISALLOW_SETUP);
+        USBSetTransferCompleteCallback(DATA_EP, OUT_FROM_HOST, DataOutComplete);
+        </code>
+
+    Precondition:
+        The endpoint should have been enabled with USBEnableEndpoint().
+
+    Parameters:
+        uint8_t ep - the endpoint number (1 to USB_MAX_EP_NUMBER).
+        uint8_t dir - the direction, either IN_TO_HOST or OUT_FROM_HOST.
+        USB_TRANSFER_COMPLETE_CALLBACK callback - the function to call, or
+                  NULL to stop calling a previously registered function.
+
+    Return Values:
+        None
+
+    Remarks:
+        The callback runs in the same context as USBDeviceTasks() (the
+        interrupt context when USB_INTERRUPT is used) and so should be short.
+        It may call USBTransferOnePacket() to re-arm the endpoint.
+
+        All callbacks are removed by USBDeviceInit() and whenever the host
+        sets the configuration, so they should be registered from the
+        EVENT_CONFIGURED handler.
+
+        Only available when USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS is
+        defined in usb_config.h.
+  **************************************************************************/
+void USBSetTransferCompleteCallback(uint8_t ep, uint8_t dir, USB_TRANSFER_COMPLETE_CALLBACK callback);
+
+/**************************************************************************
+    Function:
+        bool USBQueueTransfer(uint8_t ep, uint8_t dir, USB_TRANSFER_REQUEST *pRequest)
+
+    Summary:
+        Adds a transfer request to the queue of the specified non-EP0
+        endpoint and direction.
+
+    Description:
+        Adds a transfer request to the queue of the specified non-EP0
+        endpoint and direction.  Unlike USBTransferOnePacket(), the caller
+        does not need to wait for the endpoint to become free: the request
+        is handed to the SIE as soon as a BDT entry is available and, as
+        each transaction completes, the stack re-arms the endpoint from the
+        queue itself.  When ping-pong buffering is enabled both the even and
+        odd BDT entries are kept armed, so queued packets go out (or come
+        in) back-to-back in consecutive frames without any involvement from
+        the application.
+
+        When a request completes its len field is updated with the number
+        of bytes actually transferred, its status is set to
+        USB_TRANSFER_REQUEST_COMPLETE and its pFunc (if not NULL) is called
+        from USBDeviceTasks(), before any callback registered with
+        USBSetTransferCompleteCallback().
+
+        Typical Usage:
+        <code>
+        static USB_TRANSFER_REQUEST txRequest[2];
+
+        txRequest[0].pData = (uint8_t *) &buffer0[0];
+        txRequest[0].len = sizeof(buffer0);
+        txRequest[0].pFunc = NULL;
+        if(!USBTransferRequestBusy(&txRequest[0]))
+        {
+            USBQueueTransfer(DATA_EP, IN_TO_HOST, &txRequest[0]);
+        }
+        </code>
+
+    Precondition:
+        The endpoint must have been enabled with USBEnableEndpoint().
+
+    Parameters:
+        uint8_t ep - the endpoint number (1 to USB_MAX_EP_NUMBER).
+        uint8_t dir - the direction, either IN_TO_HOST or OUT_FROM_HOST.
+        USB_TRANSFER_REQUEST *pRequest - the request, with pData, len and
+                  pFunc filled in.
+
+    Return Values:
+        true - the request was queued.
+        false - the endpoint is invalid or the request is already busy.
+
+    Remarks:
+        An endpoint direction that is used with USBQueueTransfer() should
+        not also be armed directly with USBTransferOnePacket().
+
+        The queues are emptied, and the requests in them marked as
+        USB_TRANSFER_REQUEST_TERMINATED, on bus reset and whenever the host
+        sets the configuration.  When the host clears an endpoint halt the
+        requests on that endpoint are terminated in the same way and their
+        pFunc called, so that they may be queued again.
+
+        Only available when USB_ENABLE_TRANSFER_QUEUES is defined in
+        usb_config.h.
+  **************************************************************************/
+bool USBQueueTransfer(uint8_t ep, uint8_t dir, USB_TRANSFER_REQUEST *pRequest);
+
+/**************************************************************************
+    Function:
+        bool USBTransferRequestBusy(USB_TRANSFER_REQUEST *pRequest)
+
+    Summary:
+        Checks whether a transfer request is still queued or owned by the
+        SIE.
+
+    Parameters:
+        USB_TRANSFER_REQUEST *pRequest - the request to check.
+
+    Return Values:
+        true - the request is queued or in progress and must not be changed.
+        false - the request is free to be filled in and queued again.
+
+    Remarks:
+        None
+  **************************************************************************/
+bool USBTransferRequestBusy(USB_TRANSFER_REQUEST *pRequest);
+/*DOM-IGNORE-BEGIN*/
+#define USBTransferRequestBusy(pRequest) ((pRequest)->status >= USB_TRANSFER_REQUEST_QUEUED)
+/*DOM-IGNORE-END*/
+
 /**************************************************************************
     Function:
         void USBDeviceDetach(void)
@@ -1301,6 +1488,130 @@ bool USBIsBusSuspended(void);
 #define USBIsBusSuspended() USBBusIsSuspended
 /*DOM-IGNORE-END*/
 
+/*******************************************************************************
+  Function:
+        bool USBCBSendResume(void);
+    
+  Summary:
+    This function sends remote wakeup signalling to the host.
+
+  Description:
+    If the host has enabled remote wakeup (see USBGetRemoteWakeupStatus())
+    and the bus is suspended, this function wakes the USB module and drives
+    resume signalling onto the bus, which causes the host to resume the bus.
+    Otherwise it does nothing.
+   
+    Typical Usage:
+    <code>
+    //Something happened that the host should hear about now
+    USBCBSendResume();
+    </code>
+    
+  Conditions:
+    None
+  Input:
+    None
+  Return:
+    true if resume signalling was sent, else false.
+  Remarks:
+    This function blocks for about 15ms, with USB interrupts masked, while
+    it times the bus idle period and the resume signalling.  The device will
+    only be offered remote wakeup by the host if the _RWU attribute is set
+    in the configuration descriptor.
+  *****************************************************************************/
+bool USBCBSendResume(void);
+
+/*******************************************************************************
+  Function:
+        USB_STATISTICS *USBGetStatistics(void);
+    
+  Summary:
+    This function returns a pointer to the statistics kept by the stack.
+
+  Description:
+    When USB_ENABLE_STATISTICS is defined the stack counts bus errors by
+    class (taken from the U1EIR register), STALL handshakes, bus resets,
+    bus suspends, terminated transactions and the transactions completed
+    on each endpoint.  The counts survive bus resets and are only zeroed
+    by USBClearStatistics().
+   
+    Typical Usage:
+    <code>
+    if(USBGetStatistics()->crc16Errors != 0)
+    {
+        //Data is being corrupted on the cable
+    }
+    </code>
+    
+  Conditions:
+    None
+  Input:
+    None
+  Return:
+    A pointer to the USB_STATISTICS structure.
+  Remarks:
+    The counters are updated by USBDeviceTasks(), so in interrupt mode
+    a multi-byte counter may change while it is being read.
+  *****************************************************************************/
+USB_STATISTICS *USBGetStatistics(void);
+/*DOM-IGNORE-BEGIN*/
+#define USBGetStatistics() (&USBStatistics)
+/*DOM-IGNORE-END*/
+
+/*******************************************************************************
+  Function:
+        void USBClearStatistics(void);
+    
+  Summary:
+    This function zeroes the statistics kept by the stack.
+
+  Conditions:
+    None
+  Input:
+    None
+  Return:
+    None
+  Remarks:
+    Only available when USB_ENABLE_STATISTICS is defined in usb_config.h.
+  *****************************************************************************/
+void USBClearStatistics(void);
+
+/*******************************************************************************
+  Function:
+        void USBCheckStatisticsRequest(void);
+    
+  Summary:
+    This function handles the vendor request that reads the statistics.
+
+  Description:
+    This function should be called from the EVENT_EP0_REQUEST handler.  It
+    checks for a vendor request to the device with bRequest set to
+    USB_STATISTICS_VENDOR_REQUEST.  If the request is device to host the
+    USB_STATISTICS structure is returned (truncated to wLength), straight
+    from RAM so that nothing is copied; if the request is host to device,
+    with no data stage, the statistics are cleared.  Anything else is left
+    alone for other handlers.
+
+    Typical Usage:
+    <code>
+    case EVENT_EP0_REQUEST:
+        USBCheckCDCRequest();
+        USBCheckStatisticsRequest();
+        break;
+    </code>
+    
+  Conditions:
+    None
+  Input:
+    None
+  Return:
+    None
+  Remarks:
+    Only EP0 is used, so reading the statistics doesn't disturb the data
+    endpoints.
+  *****************************************************************************/
+void USBCheckStatisticsRequest(void);
+
 /*******************************************************************************
   Function:
         void USBSoftDetach(void);
@@ -1905,6 +2216,75 @@ uint8_t USBGetTicksSinceSuspendEnd(void);
 #define USBGetTicksSinceSuspendEnd()      USBTicksSinceSuspendEnd
 /*DOM-IGNORE-END*/
 
+/**************************************************************************
+    Function:
+        void USBHybridPoll(void)
+
+    Summary:
+        Services the USB stack while it is in the polled phase of hybrid
+        polling operation.
+
+    Description:
+        When USB_HYBRID_POLLING is defined (along with USB_INTERRUPT) the USB
+        interrupt is only left enabled while the bus is busy.  After
+        USB_HYBRID_IDLE_TIMEOUT ms without a completed transaction, and with no
+        control transfer in progress, the stack masks the USB interrupt so
+        that the 1 kHz start of frame interrupts are no longer taken.
+
+        From then on the application must call this function every
+        USB_HYBRID_POLL_PERIOD_MS.  It briefly unmasks the USB interrupt so
+        that, if the USB module has anything pending, USBDeviceTasks() runs
+        straight away from the interrupt context, just as it would in
+        interrupt mode.  If that reveals a completed transaction (bulk data,
+        a SETUP packet, a bus reset, etc.) the stack switches back to
+        interrupt operation by itself.  The same happens when the firmware
+        arms an endpoint with USBTransferOnePacket().
+
+        Typical Usage:
+        <code>
+        //From the main loop, once every USB_HYBRID_POLL_PERIOD_MS
+        USBHybridPoll();
+        </code>
+
+    PreCondition:
+        None
+
+    Parameters:
+        None
+
+    Return Values:
+        None
+
+    Remarks:
+        The 1ms tick returned by USBGet1msTickCount() keeps counting
+        correctly while polled: the elapsed time is taken from the USB frame
+        number rather than by counting start of frame interrupts.  The
+        EVENT_SOF event, however, is only thrown once per poll.
+
+        Only available when USB_HYBRID_POLLING is defined in usb_config.h.
+  **************************************************************************/
+void USBHybridPoll(void);
+
+/**************************************************************************
+    Function:
+        bool USBHybridIsInterruptMode(void)
+
+    Summary:
+        Indicates whether the stack is in the interrupt driven phase of
+        hybrid polling operation.
+
+    Return Values:
+        true - the USB interrupt is enabled because the bus is busy.
+        false - the stack is idle and is serviced by USBHybridPoll().
+
+    Remarks:
+        Only available when USB_HYBRID_POLLING is defined in usb_config.h.
+  **************************************************************************/
+bool USBHybridIsInterruptMode(void);
+/*DOM-IGNORE-BEGIN*/
+#define USBHybridIsInterruptMode() USBHybridInterruptMode
+/*DOM-IGNORE-END*/
+
 
 
 /** Section: MACROS ******************************************************/
@@ -2053,6 +2433,12 @@ extern USB_VOLATILE bool USBBusIsSuspended;
 extern USB_VOLATILE USB_DEVICE_STATE USBDeviceState;
 extern USB_VOLATILE uint8_t USBActiveConfiguration;
 extern USB_VOLATILE uint8_t USBTicksSinceSuspendEnd;
+#if defined(USB_HYBRID_POLLING)
+extern USB_VOLATILE bool USBHybridInterruptMode;
+#endif
+#if defined(USB_ENABLE_STATISTICS)
+extern USB_VOLATILE USB_STATISTICS USBStatistics;
+#endif
 /******************************************************************************/
 /* DOM-IGNORE-END */
 
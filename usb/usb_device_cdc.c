@@ -55,15 +55,71 @@ please contact mla_licensing@microchip.com
     #define IN_DATA_BUFFER_ADDRESS_TAG
     #define OUT_DATA_BUFFER_ADDRESS_TAG
     #define CONTROL_BUFFER_ADDRESS_TAG
+    #define IN_DATA_BUFFER_ODD_ADDRESS_TAG
+    #define OUT_DATA_BUFFER_ODD_ADDRESS_TAG
+#endif
+#if !defined(NOTIFICATION_BUFFER_ADDRESS_TAG)
+    #define NOTIFICATION_BUFFER_ADDRESS_TAG
+#endif
+#if !defined(CMD_IN_DATA_BUFFER_ADDRESS_TAG)
+    #define CMD_IN_DATA_BUFFER_ADDRESS_TAG
+#endif
+#if !defined(CMD_OUT_DATA_BUFFER_ADDRESS_TAG)
+    #define CMD_OUT_DATA_BUFFER_ADDRESS_TAG
+#endif
+
+//SerialState notifications are sent for a DSR pin or for the application
+#if defined(USB_CDC_SUPPORT_DSR_REPORTING) && defined(USB_CDC_SUPPORT_SERIAL_STATE_EVENTS)
+    #error "USB_CDC_SUPPORT_DSR_REPORTING and USB_CDC_SUPPORT_SERIAL_STATE_EVENTS can't both be defined."
+#endif
+#if defined(USB_CDC_SUPPORT_DSR_REPORTING) || defined(USB_CDC_SUPPORT_SERIAL_STATE_EVENTS)
+    #define CDC_SERIAL_STATE_NOTIFICATIONS
 #endif
 
 #if !defined(IN_DATA_BUFFER_ADDRESS_TAG) || !defined(OUT_DATA_BUFFER_ADDRESS_TAG) || !defined(CONTROL_BUFFER_ADDRESS_TAG)
     #error "One of the fixed memory address definitions is not defined.  Please define the required address tags for the required buffers."
 #endif
 
+//The command port moves its packets through the stack's transfer queue
+#if !defined(USB_ENABLE_TRANSFER_QUEUES)
+    #error "The command port needs USB_ENABLE_TRANSFER_QUEUES to be defined."
+#endif
+#if defined(USB_CDC_CMD_RX_RING_SIZE)
+    #if (USB_CDC_CMD_RX_RING_SIZE > 255) || (USB_CDC_CMD_RX_RING_SIZE < CDC_CMD_DATA_OUT_EP_SIZE)
+        #error "USB_CDC_CMD_RX_RING_SIZE must be between CDC_CMD_DATA_OUT_EP_SIZE and 255 bytes."
+    #endif
+#endif
+
+//With ping-pong buffering on the data endpoint the driver keeps two buffers
+//per direction, one for each BDT entry, so that one packet can be on the bus
+//while the firmware works on the other.
+#if (USB_PING_PONG_MODE == USB_PING_PONG__FULL_PING_PONG) || (USB_PING_PONG_MODE == USB_PING_PONG__ALL_BUT_EP0)
+    #define CDC_DATA_NUM_BUFFERS 2
+    #define CDCNextBuffer(index) {(index) ^= 1;}
+    #if !defined(IN_DATA_BUFFER_ODD_ADDRESS_TAG) || !defined(OUT_DATA_BUFFER_ODD_ADDRESS_TAG)
+        #error "The ping-pong CDC data buffers need IN_DATA_BUFFER_ODD_ADDRESS_TAG and OUT_DATA_BUFFER_ODD_ADDRESS_TAG to be defined."
+    #endif
+#else
+    #define CDC_DATA_NUM_BUFFERS 1
+    #define CDCNextBuffer(index)
+#endif
+
 /** V A R I A B L E S ********************************************************/
 volatile unsigned char cdc_data_tx[CDC_DATA_IN_EP_SIZE] IN_DATA_BUFFER_ADDRESS_TAG;
 volatile unsigned char cdc_data_rx[CDC_DATA_OUT_EP_SIZE] OUT_DATA_BUFFER_ADDRESS_TAG;
+#if (CDC_DATA_NUM_BUFFERS > 1)
+volatile unsigned char cdc_data_tx_odd[CDC_DATA_IN_EP_SIZE] IN_DATA_BUFFER_ODD_ADDRESS_TAG;
+volatile unsigned char cdc_data_rx_odd[CDC_DATA_OUT_EP_SIZE] OUT_DATA_BUFFER_ODD_ADDRESS_TAG;
+volatile unsigned char * const cdc_data_tx_buffer[CDC_DATA_NUM_BUFFERS] = {cdc_data_tx, cdc_data_tx_odd};
+volatile unsigned char * const cdc_data_rx_buffer[CDC_DATA_NUM_BUFFERS] = {cdc_data_rx, cdc_data_rx_odd};
+#else
+volatile unsigned char * const cdc_data_tx_buffer[CDC_DATA_NUM_BUFFERS] = {cdc_data_tx};
+volatile unsigned char * const cdc_data_rx_buffer[CDC_DATA_NUM_BUFFERS] = {cdc_data_rx};
+#endif
+
+//The command port, the second CDC function, has one buffer per direction
+volatile unsigned char cdc_cmd_tx[CDC_CMD_DATA_IN_EP_SIZE] CMD_IN_DATA_BUFFER_ADDRESS_TAG;
+volatile unsigned char cdc_cmd_rx[CDC_CMD_DATA_OUT_EP_SIZE] CMD_OUT_DATA_BUFFER_ADDRESS_TAG;
 
 typedef union
 {
@@ -76,25 +132,56 @@ typedef union
 LINE_CODING line_coding;    // Buffer to store line coding information
 CDC_NOTICE cdc_notice;
 
-#if defined(USB_CDC_SUPPORT_DSR_REPORTING)
-    SERIAL_STATE_NOTIFICATION SerialStatePacket;
+#if defined(CDC_SERIAL_STATE_NOTIFICATIONS)
+    SERIAL_STATE_NOTIFICATION SerialStatePacket NOTIFICATION_BUFFER_ADDRESS_TAG;
 #endif
 
 uint8_t cdc_rx_len;            // total rx length
 uint8_t cdc_trf_state;         // States are defined cdc.h
 POINTER pCDCSrc;            // Dedicated source pointer
 POINTER pCDCDst;            // Dedicated destination pointer
-uint8_t cdc_tx_len;            // total tx length
+uint16_t cdc_tx_len;           // total tx length
 uint8_t cdc_mem_type;          // _ROM, _RAM
+CDC_TX_PRODUCER cdc_tx_producer; // Fills each packet of a stream
+
+USB_HANDLE CDCDataOutHandle[CDC_DATA_NUM_BUFFERS];
+USB_HANDLE CDCDataInHandle[CDC_DATA_NUM_BUFFERS];
+uint8_t cdc_rx_buf;            // Index of the buffer the next OUT packet is read from
+uint8_t cdc_tx_buf;            // Index of the buffer the next IN packet goes in
+
+CDC_CMD_PORT cdc_cmd_port;      // Everything else about the command port
+bool cdc_rx_restart;           // OUT transfers terminated, re-arm both buffers
+bool cdc_tx_reserved;          // The next IN buffer is the application's, see reserveUSBUSART()
+
+#if defined(USB_CDC_TX_RING_SIZE)
+    #if (USB_CDC_TX_RING_SIZE > 255)
+        #error "USB_CDC_TX_RING_SIZE must be no more than 255 bytes."
+    #endif
+uint8_t cdc_tx_ring[USB_CDC_TX_RING_SIZE];
+uint8_t cdc_tx_ring_head;      // Where the next byte is written
+uint8_t cdc_tx_ring_count;     // Number of bytes waiting to be sent
+uint16_t cdc_tx_ring_overflow; // Number of bytes dropped because the ring was full
+uint8_t cdc_tx_held;           // Bytes held in the reserved IN buffer, see holdUSBUSART()
+#endif
 
-USB_HANDLE CDCDataOutHandle;
-USB_HANDLE CDCDataInHandle;
+#if defined(USB_CDC_TX_COALESCE_FRAMES)
+    #if !defined(USB_CDC_TX_RING_SIZE)
+        #error "USB_CDC_TX_COALESCE_FRAMES needs USB_CDC_TX_RING_SIZE to be defined."
+    #endif
+    #if (USB_CDC_TX_COALESCE_FRAMES < 1) || (USB_CDC_TX_COALESCE_FRAMES > 0x7FF)
+        #error "USB_CDC_TX_COALESCE_FRAMES must be between 1 and 0x7FF frames."
+    #endif
+uint16_t cdc_tx_ring_frame;    // Frame number when the oldest byte in the ring was written
+bool cdc_tx_flush;             // Send the ring contents without waiting
+#endif
+
+CDC_TX_COUNTERS cdc_tx_counters; // Packets and bytes sent on the CDC Bulk IN endpoint
 
 
 CONTROL_SIGNAL_BITMAP control_signal_bitmap;
 uint32_t BaudRateGen;			// BRG value calculated from baud rate
 
-#if defined(USB_CDC_SUPPORT_DSR_REPORTING)
+#if defined(CDC_SERIAL_STATE_NOTIFICATIONS)
     BM_SERIAL_STATE SerialStateBitmap;
     BM_SERIAL_STATE OldSerialStateBitmap;
     USB_HANDLE CDCNotificationInHandle;
@@ -115,6 +202,27 @@ CTRL_TRF_RETURN USB_CDC_SET_LINE_CODING_HANDLER(CTRL_TRF_PARAMS);
 
 /** P R I V A T E  P R O T O T Y P E S ***************************************/
 void USBCDCSetLineCoding(void);
+static void CDCRxStart(void);
+static void CDCRxRearm(void);
+static void CDCTxProgress(void);
+static void CDCTxSend(uint8_t length);
+#if defined(CDC_SERIAL_STATE_NOTIFICATIONS) && defined(USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS)
+static void CDCNotificationComplete(USB_HANDLE handle, uint16_t size);
+#endif
+#if defined(USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS)
+static void CDCTxComplete(USB_HANDLE handle, uint16_t size);
+#endif
+#if defined(USB_CDC_TX_RING_SIZE)
+static void CDCTxRingService(void);
+#endif
+static void CDCCmdCheckRequest(void);
+static void CDCCmdInitEP(void);
+static void CDCCmdRxQueue(void);
+#if defined(USB_CDC_CMD_RX_RING_SIZE)
+static void CDCCmdRxComplete(USB_TRANSFER_REQUEST *pRequest);
+static void CDCCmdRxRingFill(void);
+#endif
+static void CDCCmdTxComplete(USB_TRANSFER_REQUEST *pRequest);
 
 /** D E C L A R A T I O N S **************************************************/
 //#pragma code
@@ -156,6 +264,17 @@ void USBCheckCDCRequest(void)
      */
     if(SetupPkt.RequestType != USB_SETUP_TYPE_CLASS_BITFIELD) return;
 
+    /*
+     * The command port keeps its own line coding and control
+     * line state
+     */
+    if((SetupPkt.bIntfID == CDC_CMD_COMM_INTF_ID)||
+       (SetupPkt.bIntfID == CDC_CMD_DATA_INTF_ID))
+    {
+        CDCCmdCheckRequest();
+        return;
+    }
+
     /*
      * Interface ID must match interface numbers associated with
      * CDC class, else return
@@ -298,6 +417,7 @@ void CDCInitEP(void)
     line_coding.bCharFormat = 0x00;             // 1 stop bit
     line_coding.bParityType = 0x00;             // None
     line_coding.bDataBits = 0x08;               // 5,6,7,8, or 16
+    control_signal_bitmap._byte = 0x00;         // No terminal until DTR is set
 
     cdc_rx_len = 0;
     
@@ -315,13 +435,34 @@ void CDCInitEP(void)
     USBEnableEndpoint(CDC_COMM_EP,USB_IN_ENABLED|USB_HANDSHAKE_ENABLED|USB_DISALLOW_SETUP);
     USBEnableEndpoint(CDC_DATA_EP,USB_IN_ENABLED|USB_OUT_ENABLED|USB_HANDSHAKE_ENABLED|USB_DISALLOW_SETUP);
 
-    CDCDataOutHandle = USBRxOnePacket(CDC_DATA_EP,(uint8_t*)&cdc_data_rx,sizeof(cdc_data_rx));
-    CDCDataInHandle = NULL;
-
-    #if defined(USB_CDC_SUPPORT_DSR_REPORTING)
+    CDCRxStart();
+    #if defined(USB_CDC_TX_RING_SIZE)
+    cdc_tx_ring_head = 0;
+    cdc_tx_ring_count = 0;
+    cdc_tx_ring_overflow = 0;
+    cdc_tx_held = 0;
+    #endif
+    #if defined(USB_CDC_TX_COALESCE_FRAMES)
+    cdc_tx_flush = false;
+    #endif
+    cdc_tx_reserved = false;
+    CDCDataInHandle[0] = NULL;
+    #if (CDC_DATA_NUM_BUFFERS > 1)
+    CDCDataInHandle[1] = NULL;
+    #endif
+    cdc_tx_buf = 0;
+    #if defined(USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS)
+    USBSetTransferCompleteCallback(CDC_DATA_EP, IN_TO_HOST, CDCTxComplete);
+    #endif
+
+    #if defined(CDC_SERIAL_STATE_NOTIFICATIONS)
       	CDCNotificationInHandle = NULL;
+      	#if defined(USB_CDC_SUPPORT_DSR_REPORTING)
         mInitDTSPin();  //Configure DTS as a digital input
       	SerialStateBitmap.byte = 0x00;
+      	#else
+      	SerialStateBitmap.byte &= ~CDC_SERIAL_STATE_EVENTS;    //Keep the levels the application has set
+      	#endif
       	OldSerialStateBitmap.byte = !SerialStateBitmap.byte;    //To force firmware to send an initial serial state packet to the host.
         //Prepare a SerialState notification element packet (contains info like DSR state)
         SerialStatePacket.bmRequestType = 0xA1; //Always 0xA1 for this type of packet.
@@ -331,6 +472,9 @@ void CDCInitEP(void)
         SerialStatePacket.SerialState.byte = 0x00;
         SerialStatePacket.Reserved = 0x00;
         SerialStatePacket.wLength = 0x02;   //Always 2 bytes for this type of packet    
+        #if defined(USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS)
+        USBSetTransferCompleteCallback(CDC_COMM_EP, IN_TO_HOST, CDCNotificationComplete);
+        #endif
         CDCNotificationHandler();
   	#endif
   	
@@ -344,8 +488,84 @@ void CDCInitEP(void)
   	#endif
     
     cdc_trf_state = CDC_TX_READY;
+
+    CDCCmdInitEP();
 }//end CDCInitEP
 
+/******************************************************************************
+ 	Function:
+ 		static void CDCCmdCheckRequest(void)
+ 
+ 	Description:
+ 		Handles the CDC class specific requests addressed to the command
+ 		port's interfaces, which are those of the data port's that an ACM
+ 		function must support, applied to the command port's own state.
+ 		
+ 	PreCondition:
+ 		Called from USBCheckCDCRequest() for a class request to interface
+ 		CDC_CMD_COMM_INTF_ID or CDC_CMD_DATA_INTF_ID.
+  *****************************************************************************/
+static void CDCCmdCheckRequest(void)
+{
+    switch(SetupPkt.bRequest)
+    {
+        #if defined(USB_CDC_SUPPORT_ABSTRACT_CONTROL_MANAGEMENT_CAPABILITIES_D1)
+        case SET_LINE_CODING:
+            //Just kept so that it can be read back, nothing uses it
+            outPipes[0].wCount.Val = SetupPkt.wLength;
+            outPipes[0].pDst.bRam = (uint8_t*)&cdc_cmd_port.lineCoding._byte[0];
+            outPipes[0].pFunc = NULL;
+            outPipes[0].info.bits.busy = 1;
+            break;
+            
+        case GET_LINE_CODING:
+            USBEP0SendRAMPtr(
+                (uint8_t*)&cdc_cmd_port.lineCoding,
+                LINE_CODING_LENGTH,
+                USB_EP0_INCLUDE_ZERO);
+            break;
+
+        case SET_CONTROL_LINE_STATE:
+            cdc_cmd_port.controlSignals._byte = (uint8_t)SetupPkt.wValue;
+            inPipes[0].info.bits.busy = 1;
+            break;
+        #endif
+        default:
+            break;
+    }
+}
+
+/**************************************************************************
+  Function:
+        static void CDCCmdInitEP(void)
+    
+  Summary:
+    Does for the command port what CDCInitEP() does for the data port:
+    sets the default line coding, enables its endpoints and queues the Bulk
+    OUT buffer.  Its notification endpoint is enabled but never used.
+  **************************************************************************/
+static void CDCCmdInitEP(void)
+{
+    cdc_cmd_port.lineCoding.dwDTERate = 19200;
+    cdc_cmd_port.lineCoding.bCharFormat = 0x00;
+    cdc_cmd_port.lineCoding.bParityType = 0x00;
+    cdc_cmd_port.lineCoding.bDataBits = 0x08;
+    cdc_cmd_port.controlSignals._byte = 0x00;
+
+    USBEnableEndpoint(CDC_CMD_COMM_EP,USB_IN_ENABLED|USB_HANDSHAKE_ENABLED|USB_DISALLOW_SETUP);
+    USBEnableEndpoint(CDC_CMD_DATA_EP,USB_IN_ENABLED|USB_OUT_ENABLED|USB_HANDSHAKE_ENABLED|USB_DISALLOW_SETUP);
+
+    #if defined(USB_CDC_CMD_RX_RING_SIZE)
+    cdc_cmd_port.rxRingTail = 0;
+    cdc_cmd_port.rxRingCount = 0;
+    cdc_cmd_port.rxHeld = false;
+    #endif
+
+    //The stack flushed both queues, terminating any request in them,
+    //before EVENT_CONFIGURED
+    CDCCmdRxQueue();
+}
+
 
 /**************************************************************************
   Function: void CDCNotificationHandler(void)
@@ -362,9 +582,10 @@ void CDCInitEP(void)
     CDCNotificationHandler() by itself, or, by calling CDCTxService() which
     also calls CDCNotificationHandler() internally, when appropriate.
   **************************************************************************/
-#if defined(USB_CDC_SUPPORT_DSR_REPORTING)
+#if defined(CDC_SERIAL_STATE_NOTIFICATIONS)
 void CDCNotificationHandler(void)
 {
+    #if defined(USB_CDC_SUPPORT_DSR_REPORTING)
     //Check the DTS I/O pin and if a state change is detected, notify the 
     //USB host by sending a serial state notification element packet.
     if(UART_DTS == USB_CDC_DSR_ACTIVE_LEVEL) //UART_DTS must be defined to be an I/O pin in the hardware profile to use the DTS feature (ex: "PORTXbits.RXY")
@@ -375,10 +596,13 @@ void CDCNotificationHandler(void)
     {
         SerialStateBitmap.bits.DSR = 0;
     }        
+    #endif
     
     //If the state has changed, and the endpoint is available, send a packet to
-    //notify the hUSB host of the change.
-    if((SerialStateBitmap.byte != OldSerialStateBitmap.byte) && (!USBHandleBusy(CDCNotificationInHandle)))
+    //notify the hUSB host of the change.  The endpoint only exists once the
+    //device is configured.
+    if((SerialStateBitmap.byte != OldSerialStateBitmap.byte) && (!USBHandleBusy(CDCNotificationInHandle)) &&
+       (USBGetDeviceState() == CONFIGURED_STATE))
     {
         //Copy the updated value into the USB packet buffer to send.
         SerialStatePacket.SerialState.byte = SerialStateBitmap.byte;
@@ -391,12 +615,55 @@ void CDCNotificationHandler(void)
         
         //Save the old value, so we can detect changes later.
         OldSerialStateBitmap.byte = SerialStateBitmap.byte;
+
+        //Events are sent once, the next notification clears them again.
+        SerialStateBitmap.byte &= ~CDC_SERIAL_STATE_EVENTS;
     }    
 }//void CDCNotificationHandler(void)    
+
+#if defined(USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS)
+/**************************************************************************
+  Function:
+        static void CDCNotificationComplete(USB_HANDLE handle, uint16_t size)
+    
+  Summary:
+    Transfer complete callback for the CDC comm endpoint, called from
+    USBDeviceTasks().  Sends any change that happened while the last
+    notification was on its way, e.g. the clearing of an event.
+  **************************************************************************/
+static void CDCNotificationComplete(USB_HANDLE handle, uint16_t size)
+{
+    CDCNotificationHandler();
+}
+#endif
 #else
     #define CDCNotificationHandler() {}
 #endif
 
+#if defined(USB_CDC_SUPPORT_SERIAL_STATE_EVENTS)
+/**************************************************************************
+  Function: void CDCSetSerialState(uint8_t mask, uint8_t state)
+  Summary: Reports application events to the USB host as SerialState
+           notifications.
+  Description:
+    See usb_device_cdc.h.
+  Conditions:
+    None
+  Input:
+    uint8_t mask - the CDC_SERIAL_STATE_xxx bits to change.
+    uint8_t state - their new values.
+  **************************************************************************/
+void CDCSetSerialState(uint8_t mask, uint8_t state)
+{
+    USBMaskInterrupts();
+    //Levels take the new value, events are added to any still to be sent
+    SerialStateBitmap.byte &= ~(mask & ~CDC_SERIAL_STATE_EVENTS);
+    SerialStateBitmap.byte |= (state & mask);
+    CDCNotificationHandler();
+    USBUnmaskInterrupts();
+}//end CDCSetSerialState
+#endif
+
 
 /**********************************************************************************
   Function:
@@ -423,20 +690,33 @@ void CDCNotificationHandler(void)
   **********************************************************************************/
 bool USBCDCEventHandler(USB_EVENT event, void *pdata, uint16_t size)
 {
+    uint8_t i;
+
     switch( (uint16_t)event )
     {  
         case EVENT_TRANSFER_TERMINATED:
-            if(pdata == CDCDataOutHandle)
-            {
-                CDCDataOutHandle = USBRxOnePacket(CDC_DATA_EP,(uint8_t*)&cdc_data_rx,sizeof(cdc_data_rx));
-            }
-            if(pdata == CDCDataInHandle)
+            for(i = 0; i < CDC_DATA_NUM_BUFFERS; i++)
             {
-                //flush all of the data in the CDC buffer
-                cdc_trf_state = CDC_TX_READY;
-                cdc_tx_len = 0;
+                if(pdata == CDCDataOutHandle[i])
+                {
+                    //The stack may not have finished with the other BDT entry
+                    //yet so re-arm both from getsUSBUSART()/peekUSBUSART()
+                    cdc_rx_restart = true;
+                }
+                if(pdata == CDCDataInHandle[i])
+                {
+                    //flush all of the data in the CDC buffer
+                    cdc_trf_state = CDC_TX_READY;
+                    cdc_tx_len = 0;
+                }
             }
             break;
+        #if defined(USB_CDC_TX_COALESCE_FRAMES)
+        case EVENT_SOF:
+            //Send any data held in the ring whose time is up
+            CDCTxProgress();
+            break;
+        #endif
         default:
             return false;
     }      
@@ -484,28 +764,34 @@ bool USBCDCEventHandler(USB_EVENT event, void *pdata, uint16_t size)
   **********************************************************************************/
 uint8_t getsUSBUSART(uint8_t *buffer, uint8_t len)
 {
+    volatile unsigned char *pSrc;
+
     cdc_rx_len = 0;
     
-    if(!USBHandleBusy(CDCDataOutHandle))
+    if(cdc_rx_restart)
+        CDCRxStart();
+
+    if(!USBHandleBusy(CDCDataOutHandle[cdc_rx_buf]))
     {
         /*
          * Adjust the expected number of BYTEs to equal
          * the actual number of BYTEs received.
          */
-        if(len > USBHandleGetLength(CDCDataOutHandle))
-            len = USBHandleGetLength(CDCDataOutHandle);
+        if(len > USBHandleGetLength(CDCDataOutHandle[cdc_rx_buf]))
+            len = USBHandleGetLength(CDCDataOutHandle[cdc_rx_buf]);
         
         /*
          * Copy data from dual-ram buffer to user's buffer
          */
+        pSrc = cdc_data_rx_buffer[cdc_rx_buf];
         for(cdc_rx_len = 0; cdc_rx_len < len; cdc_rx_len++)
-            buffer[cdc_rx_len] = cdc_data_rx[cdc_rx_len];
+            buffer[cdc_rx_len] = pSrc[cdc_rx_len];
 
         /*
          * Prepare dual-ram buffer for next OUT transaction
          */
 
-        CDCDataOutHandle = USBRxOnePacket(CDC_DATA_EP,(uint8_t*)&cdc_data_rx,sizeof(cdc_data_rx));
+        CDCRxRearm();
 
     }//end if
     
@@ -513,9 +799,122 @@ uint8_t getsUSBUSART(uint8_t *buffer, uint8_t len)
     
 }//end getsUSBUSART
 
+/**********************************************************************************
+  Function:
+        uint8_t peekUSBUSART(uint8_t **data)
+    
+  Summary:
+    peekUSBUSART gives the caller direct access to the data received through
+    the USB CDC Bulk OUT endpoint, without copying it. It is a non-blocking
+    function that returns '0' if there is no data available.
+
+  Description:
+    See usb_device_cdc.h.
+  Conditions:
+    CDCInitEP() must have been called previously.
+  Input:
+    data -    Pointer to a pointer which is set to the received data.
+                                                                                   
+  **********************************************************************************/
+uint8_t peekUSBUSART(uint8_t **data)
+{
+    cdc_rx_len = 0;
+
+    if(cdc_rx_restart)
+        CDCRxStart();
+
+    if(!USBHandleBusy(CDCDataOutHandle[cdc_rx_buf]))
+    {
+        cdc_rx_len = USBHandleGetLength(CDCDataOutHandle[cdc_rx_buf]);
+        if(cdc_rx_len == 0)
+        {
+            /*
+             * Nothing for the caller to commit so re-arm
+             * straight away after a zero length packet
+             */
+            CDCRxRearm();
+        }
+        else
+        {
+            *data = (uint8_t*)cdc_data_rx_buffer[cdc_rx_buf];
+        }
+    }//end if
+
+    return cdc_rx_len;
+
+}//end peekUSBUSART
+
+/**********************************************************************************
+  Function:
+        void commitUSBUSART(void)
+    
+  Summary:
+    commitUSBUSART gives the CDC Bulk OUT endpoint buffer back to the USB
+    module after a successful peekUSBUSART().
+
+  Description:
+    See usb_device_cdc.h.
+  Conditions:
+    CDCInitEP() must have been called previously.
+  Input:
+    None
+                                                                                   
+  **********************************************************************************/
+void commitUSBUSART(void)
+{
+    /*
+     * Prepare dual-ram buffer for next OUT transaction,
+     * if we have it
+     */
+    if(!cdc_rx_restart && !USBHandleBusy(CDCDataOutHandle[cdc_rx_buf]))
+    {
+        CDCRxRearm();
+    }
+
+}//end commitUSBUSART
+
+/**********************************************************************************
+  Function:
+        static void CDCRxStart(void)
+    
+  Summary:
+    Arms every CDC Bulk OUT buffer, in order, and makes the first of them the
+    one that data is read from next.
+  Conditions:
+    None of the CDC Bulk OUT buffers may be owned by the SIE.
+                                                                                   
+  **********************************************************************************/
+static void CDCRxStart(void)
+{
+    cdc_rx_restart = false;
+    for(cdc_rx_buf = 0; cdc_rx_buf < CDC_DATA_NUM_BUFFERS; cdc_rx_buf++)
+    {
+        CDCDataOutHandle[cdc_rx_buf] = USBRxOnePacket(CDC_DATA_EP,(uint8_t*)cdc_data_rx_buffer[cdc_rx_buf],CDC_DATA_OUT_EP_SIZE);
+    }
+    cdc_rx_buf = 0;
+}
+
+/**********************************************************************************
+  Function:
+        static void CDCRxRearm(void)
+    
+  Summary:
+    Gives the CDC Bulk OUT buffer that data was just read from back to the SIE
+    and moves on to the next one.  The stack arms the BDT entries in ping-pong
+    order, which is also the order that the buffers fill in.
+  Conditions:
+    The current CDC Bulk OUT buffer must not be owned by the SIE.
+                                                                                   
+  **********************************************************************************/
+static void CDCRxRearm(void)
+{
+    CDCDataOutHandle[cdc_rx_buf] = USBRxOnePacket(CDC_DATA_EP,(uint8_t*)cdc_data_rx_buffer[cdc_rx_buf],CDC_DATA_OUT_EP_SIZE);
+    CDCNextBuffer(cdc_rx_buf);
+}
+
 /******************************************************************************
   Function:
-	void putUSBUSART(char *data, uint8_t length)
+	void putUSBUSART(char *data, uint16_t length)
 		
   Summary:
     putUSBUSART writes an array of data to the USB. Use this version, is
@@ -546,14 +945,14 @@ uint8_t getsUSBUSART(uint8_t *buffer, uint8_t len)
     USBUSARTIsTxTrfReady() must return true. This indicates that the last
     transfer is complete and is ready to receive a new block of data. The
     string of characters pointed to by 'data' must equal to or smaller than
-    255 BYTEs.
+    65535 BYTEs.
 
   Input:
     char *data - pointer to a RAM array of data to be transfered to the host
-    uint8_t length - the number of bytes to be transfered (must be less than 255).
+    uint16_t length - the number of bytes to be transfered (must be less than 65536).
 		
  *****************************************************************************/
-void putUSBUSART(uint8_t *data, uint8_t  length)
+void putUSBUSART(uint8_t *data, uint16_t length)
 {
     /*
      * User should have checked that cdc_trf_state is in CDC_TX_READY state
@@ -582,6 +981,7 @@ void putUSBUSART(uint8_t *data, uint8_t  length)
     if(cdc_trf_state == CDC_TX_READY)
     {
         mUSBUSARTTxRam((uint8_t*)data, length);     // See cdc.h
+        CDCTxProgress();
     }
     USBUnmaskInterrupts();
 }//end putUSBUSART
@@ -617,18 +1017,18 @@ void putUSBUSART(uint8_t *data, uint8_t  length)
     USBUSARTIsTxTrfReady() must return true. This indicates that the last
     transfer is complete and is ready to receive a new block of data. The
     string of characters pointed to by 'data' must equal to or smaller than
-    255 BYTEs.
+    65535 BYTEs.
 
   Input:
     char *data -  null\-terminated string of constant data. If a
-                            null character is not found, 255 BYTEs of data
+                            null character is not found, 65535 BYTEs of data
                             will be transferred to the host.
 		
  *****************************************************************************/
  
 void putsUSBUSART(char *data)
 {
-    uint8_t len;
+    uint16_t len;
     char *pData;
 
     /*
@@ -670,16 +1070,17 @@ void putsUSBUSART(char *data)
     do
     {
         len++;
-        if(len == 255) break;       // Break loop once max len is reached.
+        if(len == 0xFFFF) break;    // Break loop once max len is reached.
     }while(*pData++);
     
     /*
      * Second piece of information (length of data to send) is ready.
      * Call mUSBUSARTTxRam to setup the transfer.
-     * The actual transfer process will be handled by CDCTxService(),
-     * which should be called once per Main Program loop.
+     * The first packet goes straight away, the rest are sent
+     * by CDCTxProgress() as the packets before them complete.
      */
     mUSBUSARTTxRam((uint8_t*)data, len);     // See cdc.h
+    CDCTxProgress();
     USBUnmaskInterrupts();
 }//end putsUSBUSART
 
@@ -715,17 +1116,17 @@ void putsUSBUSART(char *data)
     USBUSARTIsTxTrfReady() must return true. This indicates that the last
     transfer is complete and is ready to receive a new block of data. The
     string of characters pointed to by 'data' must equal to or smaller than
-    255 BYTEs.
+    65535 BYTEs.
 
   Input:
     const const char *data -  null\-terminated string of constant data. If a
-                            null character is not found, 255 uint8_ts of data
+                            null character is not found, 65535 uint8_ts of data
                             will be transferred to the host.
                                                                            
   **************************************************************************/
 void putrsUSBUSART(const const char *data)
 {
-    uint8_t len;
+    uint16_t len;
     const const char *pData;
 
     /*
@@ -767,169 +1168,948 @@ void putrsUSBUSART(const const char *data)
     do
     {
         len++;
-        if(len == 255) break;       // Break loop once max len is reached.
+        if(len == 0xFFFF) break;    // Break loop once max len is reached.
     }while(*pData++);
     
     /*
      * Second piece of information (length of data to send) is ready.
      * Call mUSBUSARTTxRom to setup the transfer.
-     * The actual transfer process will be handled by CDCTxService(),
-     * which should be called once per Main Program loop.
+     * The first packet goes straight away, the rest are sent
+     * by CDCTxProgress() as the packets before them complete.
      */
 
     mUSBUSARTTxRom((const uint8_t*)data,len); // See cdc.h
+    CDCTxProgress();
     USBUnmaskInterrupts();
 
 }//end putrsUSBUSART
 
-/************************************************************************
+/******************************************************************************
   Function:
-        void CDCTxService(void)
+	bool streamUSBUSART(CDC_TX_PRODUCER producer)
+
+  Summary:
+    streamUSBUSART sends a stream of data of any length, each packet being
+    filled by 'producer' as it is needed.
+
+  Description:
+    See usb_device_cdc.h.
+
+  Conditions:
+    None
+
+  Input:
+    CDC_TX_PRODUCER producer - the function that fills each packet.
+
+  Output:
+    bool - true if the stream was started, false if the transmit path was
+           busy.
+ *****************************************************************************/
+bool streamUSBUSART(CDC_TX_PRODUCER producer)
+{
+    bool started = false;
+
+    USBMaskInterrupts();
+    if(cdc_trf_state == CDC_TX_READY)
+    {
+        cdc_tx_reserved = false;
+        cdc_tx_producer = producer;
+        cdc_trf_state = CDC_TX_STREAMING;
+        CDCTxProgress();
+        started = true;
+    }
+    USBUnmaskInterrupts();
+
+    return started;
+}//end streamUSBUSART
+
+/**************************************************************************
+  Function:
+        uint8_t *reserveUSBUSART(void)
     
   Summary:
-    CDCTxService handles device-to-host transaction(s). This function
-    should be called once per Main Program loop after the device reaches
-    the configured state.
+    reserveUSBUSART gives the caller direct access to the CDC Bulk IN endpoint
+    buffer, so that data can be written straight into it rather than being
+    copied there by CDCTxService().
+
   Description:
-    CDCTxService handles device-to-host transaction(s). This function
-    should be called once per Main Program loop after the device reaches
-    the configured state (after the CDCIniEP() function has already executed).
-    This function is needed, in order to advance the internal software state 
-    machine that takes care of sending multiple transactions worth of IN USB
-    data to the host, associated with CDC serial data.  Failure to call 
-    CDCTxService() periodically will prevent data from being sent to the
-    USB host, over the CDC serial data interface.
+    reserveUSBUSART gives the caller direct access to the CDC Bulk IN endpoint
+    buffer, so that data can be written straight into it rather than being
+    copied there by CDCTxService(). If the CDC transmit path is idle a pointer
+    to the CDC_DATA_IN_EP_SIZE byte endpoint buffer is returned, otherwise
+    NULL is returned. Once the data is in place submitUSBUSART() arms the
+    endpoint to send it.
     
     Typical Usage:
     <code>
-    void main(void)
-    {
-        USBDeviceInit();
-        while(1)
-        {
-            USBDeviceTasks();
-            if((USBGetDeviceState() \< CONFIGURED_STATE) ||
-               (USBIsDeviceSuspended() == true))
-            {
-                //Either the device is not configured or we are suspended
-                //  so we don't want to do execute any application code
-                continue;   //go back to the top of the while loop
-            }
-            else
-            {
-                //Keep trying to send data to the PC as required
-                CDCTxService();
+        uint8_t *buffer;
     
-                //Run application code.
-                UserApplication();
-            }
+        buffer = reserveUSBUSART();
+        if(buffer != NULL)
+        {
+            buffer[0] = 'O';
+            buffer[1] = 'K';
+            submitUSBUSART(2);
         }
-    }
     </code>
+
   Conditions:
-    CDCIniEP() function should have already executed/the device should be
-    in the CONFIGURED_STATE.
+    CDCInitEP() must have been called previously.
+
+  Input:
+    None
+
+  Output:
+    uint8_t * - pointer to the endpoint buffer, NULL if it isn't free.
+                                                                           
   Remarks:
-    None                                                                 
-  ************************************************************************/
- 
-void CDCTxService(void)
+    While a reservation is held nothing else, the transmit ring included, is
+    sent; it ends with submitUSBUSART(), holdUSBUSART() or releaseUSBUSART().
+    Don't call putUSBUSART() or its relatives while holding one.
+  **************************************************************************/
+uint8_t *reserveUSBUSART(void)
 {
-    uint8_t byte_to_send;
-    uint8_t i;
-    
+    uint8_t *pBuffer = NULL;
+
+    /*
+     * The buffer is only ours if there's no transfer in
+     * progress and the SIE is done with it
+     */
     USBMaskInterrupts();
-    
-    CDCNotificationHandler();
-    
-    if(USBHandleBusy(CDCDataInHandle)) 
+    if((cdc_trf_state == CDC_TX_READY) && !USBHandleBusy(CDCDataInHandle[cdc_tx_buf]))
     {
-        USBUnmaskInterrupts();
-        return;
+        cdc_tx_reserved = true;
+        pBuffer = (uint8_t*)cdc_data_tx_buffer[cdc_tx_buf];
     }
+    USBUnmaskInterrupts();
 
+    return pBuffer;
+}//end reserveUSBUSART
+
+/**************************************************************************
+  Function:
+        void submitUSBUSART(uint8_t length)
+    
+  Summary:
+    submitUSBUSART sends data written into the buffer returned by
+    reserveUSBUSART().
+
+  Description:
+    submitUSBUSART arms the CDC Bulk IN endpoint to send the first 'length'
+    bytes of the buffer returned by reserveUSBUSART(). A zero length packet
+    follows automatically if 'length' is CDC_DATA_IN_EP_SIZE. As with the
+    putUSBUSART() family, USBUSARTIsTxTrfReady() returns false until the
+    transfer has completed.
+    
+  Conditions:
+    The buffer must still be reserved, see reserveUSBUSART(), or hold data
+    from holdUSBUSART(); otherwise nothing is sent.
+
+  Input:
+    uint8_t length - the number of bytes to send, at most CDC_DATA_IN_EP_SIZE.
+                                                                           
+  **************************************************************************/
+void submitUSBUSART(uint8_t length)
+{
+    bool owned;
+
+    USBMaskInterrupts();
     /*
-     * Completing stage is necessary while [ mCDCUSartTxIsBusy()==1 ].
-     * By having this stage, user can always check cdc_trf_state,
-     * and not having to call mCDCUsartTxIsBusy() directly.
+     * Only a reservation, or held data, keeps cdc_tx_buf on the
+     * buffer the caller wrote to
      */
-    if(cdc_trf_state == CDC_TX_COMPLETING)
-        cdc_trf_state = CDC_TX_READY;
+    owned = cdc_tx_reserved;
+    #if defined(USB_CDC_TX_RING_SIZE)
+    owned = owned || (cdc_tx_held != 0);
+    #endif
+    if(owned && (cdc_trf_state == CDC_TX_READY) && !USBHandleBusy(CDCDataInHandle[cdc_tx_buf]))
+    {
+        if(length > sizeof(cdc_data_tx))
+            length = sizeof(cdc_data_tx);
+        cdc_tx_reserved = false;
+        #if defined(USB_CDC_TX_RING_SIZE)
+        cdc_tx_held = 0;
+        #endif
+
+        /*
+         * The data is already in place so go straight to the
+         * state CDCTxService() would be in after copying the
+         * last packet of a put, see explanation in USB
+         * Specification 2.0: Section 5.8.3 regarding the ZLP
+         */
+        cdc_tx_len = 0;
+        if(length == CDC_DATA_IN_EP_SIZE)
+            cdc_trf_state = CDC_TX_BUSY_ZLP;
+        else
+            cdc_trf_state = CDC_TX_COMPLETING;
+        CDCTxSend(length);
+        CDCTxProgress();
+    }
+    USBUnmaskInterrupts();
+}//end submitUSBUSART
+
+/**************************************************************************
+  Function:
+        void releaseUSBUSART(void)
     
+  Summary:
+    releaseUSBUSART gives up the buffer returned by reserveUSBUSART() without
+    sending anything from it.
+
+  Description:
+    See usb_device_cdc.h.
+  Conditions:
+    None
+  **************************************************************************/
+void releaseUSBUSART(void)
+{
+    USBMaskInterrupts();
+    cdc_tx_reserved = false;
+    CDCTxProgress();
+    USBUnmaskInterrupts();
+}//end releaseUSBUSART
+
+#if defined(USB_CDC_TX_RING_SIZE)
+/**************************************************************************
+  Function:
+        void holdUSBUSART(uint8_t length)
+    
+  Summary:
+    holdUSBUSART keeps data written into the buffer returned by
+    reserveUSBUSART() there, so that more can be added before it is sent.
+
+  Description:
+    holdUSBUSART keeps data written into the buffer returned by
+    reserveUSBUSART() there, so that more can be added before it is sent.
+    While the first 'length' bytes are held reserveUSBUSART() goes on
+    returning the same buffer, with the held bytes at the start, and
+    USBUSARTTxHeld() returns 'length'.  The held bytes are sent by
+    submitUSBUSART() with the new total length or, ahead of it, as soon as
+    anything is written to the transmit ring; so they must always make
+    sense on their own.  A length of 0 gives the buffer up.
+    
+  Conditions:
+    The buffer must still be reserved, see reserveUSBUSART(); otherwise
+    nothing is held.
+
+  Input:
+    uint8_t length - the number of bytes to hold, at most CDC_DATA_IN_EP_SIZE.
+                                                                           
+  Remarks:
+    Only available when USB_CDC_TX_RING_SIZE is defined in usb_config.h.
+    As with a reservation, don't call putUSBUSART() or its relatives while
+    holding data.
+  **************************************************************************/
+void holdUSBUSART(uint8_t length)
+{
+    USBMaskInterrupts();
+    if(cdc_tx_reserved && (cdc_trf_state == CDC_TX_READY) && !USBHandleBusy(CDCDataInHandle[cdc_tx_buf]))
+    {
+        if(length > sizeof(cdc_data_tx))
+            length = sizeof(cdc_data_tx);
+        cdc_tx_reserved = false;
+        cdc_tx_held = length;
+        CDCTxProgress();
+    }
+    USBUnmaskInterrupts();
+}//end holdUSBUSART
+
+/**************************************************************************
+  Function:
+        uint8_t writeUSBUSART(const uint8_t *data, uint8_t length)
+    
+  Summary:
+    writeUSBUSART adds data to the CDC transmit ring buffer, from where it
+    is sent to the host.
+
+  Description:
+    writeUSBUSART adds data to the CDC transmit ring buffer, from where it
+    is sent to the host. Unlike putUSBUSART() it can be
+    called at any time, whether or not USBUSARTIsTxTrfReady() is true, and
+    the data is copied so the caller's buffer is free as soon as it returns.
+    Whenever the transmit path is idle up to CDC_DATA_IN_EP_SIZE bytes are
+    taken from the ring and sent as one packet.
+    If the ring is full the data that doesn't fit is dropped and counted,
+    see USBUSARTTxOverflowCount().
+    
+    Typical Usage:
+    <code>
+        writeUSBUSART((const uint8_t*)"Motor on\r\n", 10);
+    </code>
+
+  Conditions:
+    None
+
+  Input:
+    const uint8_t *data - the data to send
+    uint8_t length - the number of bytes to send
+
+  Output:
+    uint8_t - the number of bytes accepted into the ring.
+                                                                           
+  Remarks:
+    Only available when USB_CDC_TX_RING_SIZE is defined in usb_config.h.
+    The ring is only drained when the putUSBUSART() family and
+    submitUSBUSART() are not busy, so the order of data sent through the
+    ring and through them is not preserved.
+  **************************************************************************/
+uint8_t writeUSBUSART(const uint8_t *data, uint8_t length)
+{
+    uint8_t accepted = 0;
+
+    USBMaskInterrupts();
+    #if defined(USB_CDC_TX_COALESCE_FRAMES)
+    if((cdc_tx_ring_count == 0) && (length != 0))
+        cdc_tx_ring_frame = USBHALGetFrameNumber();
+    #endif
+    while((accepted < length) && (cdc_tx_ring_count < USB_CDC_TX_RING_SIZE))
+    {
+        cdc_tx_ring[cdc_tx_ring_head] = *data;
+        data++;
+        cdc_tx_ring_head++;
+        if(cdc_tx_ring_head >= USB_CDC_TX_RING_SIZE)
+            cdc_tx_ring_head = 0;
+        cdc_tx_ring_count++;
+        accepted++;
+    }
+
     /*
-     * If CDC_TX_READY state, nothing to do, just return.
+     * Count whatever didn't fit
      */
-    if(cdc_trf_state == CDC_TX_READY)
+    length -= accepted;
+    if(cdc_tx_ring_overflow > (uint16_t)(0xFFFF - length))
+        cdc_tx_ring_overflow = 0xFFFF;
+    else
+        cdc_tx_ring_overflow += length;
+
+    CDCTxProgress();
+    USBUnmaskInterrupts();
+
+    return accepted;
+}//end writeUSBUSART
+
+/**************************************************************************
+  Function:
+        void flushUSBUSART(void)
+    
+  Summary:
+    flushUSBUSART sends the data in the CDC transmit ring buffer without
+    waiting for more to fill the packet.
+
+  Description:
+    flushUSBUSART sends the data in the CDC transmit ring buffer without
+    waiting for more to fill the packet.  It doesn't wait for the data to
+    go, it ends the coalescing window for everything written so far.
+    
+  Conditions:
+    None
+
+  Input:
+    None
+                                                                           
+  Remarks:
+    Only available when USB_CDC_TX_RING_SIZE is defined in usb_config.h.
+    Without USB_CDC_TX_COALESCE_FRAMES the ring is never held so this
+    does nothing.
+  **************************************************************************/
+void flushUSBUSART(void)
+{
+    #if defined(USB_CDC_TX_COALESCE_FRAMES)
+    USBMaskInterrupts();
+    if(cdc_tx_ring_count != 0)
     {
-        USBUnmaskInterrupts();
-        return;
+        cdc_tx_flush = true;
+        CDCTxProgress();
     }
+    USBUnmaskInterrupts();
+    #endif
+}//end flushUSBUSART
+
+/************************************************************************
+  Function:
+        static void CDCTxRingService(void)
     
+  Summary:
+    Sends up to a packet's worth of data from the transmit ring buffer.
+  Conditions:
+    Called from CDCTxProgress() with the state CDC_TX_READY and the next
+    IN buffer free.
+  ************************************************************************/
+static void CDCTxRingService(void)
+{
+    uint8_t byte_to_send;
+    uint8_t tail;
+    uint8_t i;
+
+    byte_to_send = cdc_tx_ring_count;
+    if(byte_to_send > CDC_DATA_IN_EP_SIZE)
+        byte_to_send = CDC_DATA_IN_EP_SIZE;
+
     /*
-     * If CDC_TX_BUSY_ZLP state, send zero length packet
+     * The oldest byte is count bytes behind the head
      */
-    if(cdc_trf_state == CDC_TX_BUSY_ZLP)
+    if(cdc_tx_ring_head >= cdc_tx_ring_count)
+        tail = cdc_tx_ring_head - cdc_tx_ring_count;
+    else
+        tail = (uint8_t)(cdc_tx_ring_head + USB_CDC_TX_RING_SIZE - cdc_tx_ring_count);
+
+    pCDCDst.bRam = (uint8_t*)cdc_data_tx_buffer[cdc_tx_buf];
+    for(i = 0; i < byte_to_send; i++)
     {
-        CDCDataInHandle = USBTxOnePacket(CDC_DATA_EP,NULL,0);
-        //CDC_DATA_BD_IN.CNT = 0;
+        *pCDCDst.bRam = cdc_tx_ring[tail];
+        pCDCDst.bRam++;
+        tail++;
+        if(tail >= USB_CDC_TX_RING_SIZE)
+            tail = 0;
+    }
+    cdc_tx_ring_count -= byte_to_send;
+    #if defined(USB_CDC_TX_COALESCE_FRAMES)
+    if(cdc_tx_ring_count == 0)
+        cdc_tx_flush = false;
+    #endif
+
+    /*
+     * A full packet that empties the ring needs a zero length
+     * packet after it, see USB Specification 2.0: Section 5.8.3
+     */
+    if((byte_to_send == CDC_DATA_IN_EP_SIZE) && (cdc_tx_ring_count == 0))
+        cdc_trf_state = CDC_TX_BUSY_ZLP;
+    else
         cdc_trf_state = CDC_TX_COMPLETING;
+    CDCTxSend(byte_to_send);
+}
+#endif
+
+/**************************************************************************
+  Function:
+        void getUSBUSARTTxCounters(CDC_TX_COUNTERS *counters, bool clear)
+    
+  Summary:
+    getUSBUSARTTxCounters reads the number of packets and bytes sent on the
+    CDC Bulk IN endpoint.
+
+  Description:
+    getUSBUSARTTxCounters reads the number of packets and bytes sent on the
+    CDC Bulk IN endpoint, by all of the transmit functions, since the
+    counters were last cleared.  Zero length packets count as packets.
+    Dividing bytes by packets gives the average packet fill, which is what
+    USB_CDC_TX_COALESCE_FRAMES trades against latency.
+    
+  Conditions:
+    None
+
+  Input:
+    CDC_TX_COUNTERS *counters - where to put the counts, may be NULL.
+    bool clear - true to zero the counters once they have been read.
+                                                                           
+  **************************************************************************/
+void getUSBUSARTTxCounters(CDC_TX_COUNTERS *counters, bool clear)
+{
+    USBMaskInterrupts();
+    if(counters != NULL)
+        *counters = cdc_tx_counters;
+    if(clear)
+    {
+        cdc_tx_counters.packets = 0;
+        cdc_tx_counters.bytes = 0;
     }
-    else if(cdc_trf_state == CDC_TX_BUSY)
+    USBUnmaskInterrupts();
+}//end getUSBUSARTTxCounters
+
+/************************************************************************
+  Function:
+        static void CDCTxSend(uint8_t length)
+    
+  Summary:
+    Arms the next IN buffer to send 'length' bytes and counts the packet.
+  Conditions:
+    Called from USBDeviceTasks() or with USB interrupts masked, with the
+    next IN buffer free.
+  ************************************************************************/
+static void CDCTxSend(uint8_t length)
+{
+    CDCDataInHandle[cdc_tx_buf] = USBTxOnePacket(CDC_DATA_EP,(uint8_t*)cdc_data_tx_buffer[cdc_tx_buf],length);
+    CDCNextBuffer(cdc_tx_buf);
+    cdc_tx_counters.packets++;
+    cdc_tx_counters.bytes += length;
+}
+
+/************************************************************************
+  Function:
+        void CDCTxService(void)
+    
+  Summary:
+    CDCTxService handles device-to-host transaction(s). This function
+    should be called once per Main Program loop after the device reaches
+    the configured state.
+  Description:
+    CDCTxService handles device-to-host transaction(s). This function
+    should be called once per Main Program loop after the device reaches
+    the configured state (after the CDCIniEP() function has already executed).
+    This function is needed, in order to advance the internal software state 
+    machine that takes care of sending multiple transactions worth of IN USB
+    data to the host, associated with CDC serial data.  Failure to call 
+    CDCTxService() periodically will prevent data from being sent to the
+    USB host, over the CDC serial data interface.
+
+    When USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS is defined in usb_config.h
+    the state machine is also advanced from the transfer complete callback
+    of the CDC Bulk IN endpoint, so the packets of a long transfer go out
+    as fast as the host takes them.  Calling CDCTxService() is then only
+    needed after using mUSBUSARTTxRam() or mUSBUSARTTxRom() directly, or
+    for USB_CDC_SUPPORT_DSR_REPORTING.
+    
+    Typical Usage:
+    <code>
+    void main(void)
     {
-        /*
-         * First, have to figure out how many byte of data to send.
-         */
-    	if(cdc_tx_len > sizeof(cdc_data_tx))
-    	    byte_to_send = sizeof(cdc_data_tx);
-    	else
-    	    byte_to_send = cdc_tx_len;
+        USBDeviceInit();
+        while(1)
+        {
+            USBDeviceTasks();
+            if((USBGetDeviceState() \< CONFIGURED_STATE) ||
+               (USBIsDeviceSuspended() == true))
+            {
+                //Either the device is not configured or we are suspended
+                //  so we don't want to do execute any application code
+                continue;   //go back to the top of the while loop
+            }
+            else
+            {
+                //Keep trying to send data to the PC as required
+                CDCTxService();
+    
+                //Run application code.
+                UserApplication();
+            }
+        }
+    }
+    </code>
+  Conditions:
+    CDCIniEP() function should have already executed/the device should be
+    in the CONFIGURED_STATE.
+  Remarks:
+    None                                                                 
+  ************************************************************************/
+ 
+void CDCTxService(void)
+{
+    USBMaskInterrupts();
+    
+    CDCNotificationHandler();
+    
+    CDCTxProgress();
 
+    USBUnmaskInterrupts();
+}//end CDCTxService
+
+#if defined(USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS)
+/************************************************************************
+  Function:
+        static void CDCTxComplete(USB_HANDLE handle, uint16_t size)
+    
+  Summary:
+    Transfer complete callback for the CDC Bulk IN endpoint, called from
+    USBDeviceTasks().  A buffer has just been freed so fill it with the
+    next packet, if there is one.
+  ************************************************************************/
+static void CDCTxComplete(USB_HANDLE handle, uint16_t size)
+{
+    CDCTxProgress();
+}
+#endif
+
+/************************************************************************
+  Function:
+        static void CDCTxProgress(void)
+    
+  Summary:
+    Advances the CDC transmit state machine, filling every free IN buffer.
+  Conditions:
+    Called from USBDeviceTasks() or with USB interrupts masked.
+  ************************************************************************/
+static void CDCTxProgress(void)
+{
+    uint8_t byte_to_send;
+    uint8_t i;
+    
+    /*
+     * Data may be written to the ring before the endpoint exists
+     */
+    if(USBGetDeviceState() != CONFIGURED_STATE)
+        return;
+
+    /*
+     * Keep going while the buffer the next packet goes in is free;
+     * with ping-pong buffering the previous packet may still be on
+     * its way, or both buffers may be free.
+     */
+    while(!USBHandleBusy(CDCDataInHandle[cdc_tx_buf]))
+    {
         /*
-         * Subtract the number of bytes just about to be sent from the total.
+         * Completing stage is necessary while [ mCDCUSartTxIsBusy()==1 ].
+         * By having this stage, user can always check cdc_trf_state,
+         * and not having to call mCDCUsartTxIsBusy() directly.
+         * With ping-pong buffering the state goes to CDC_TX_READY as
+         * soon as there's a free buffer, so new data can be queued
+         * while the last packet of the previous lot is on the bus.
          */
-    	cdc_tx_len = cdc_tx_len - byte_to_send;
-    	  
-        pCDCDst.bRam = (uint8_t*)&cdc_data_tx; // Set destination pointer
+        if(cdc_trf_state == CDC_TX_COMPLETING)
+            cdc_trf_state = CDC_TX_READY;
         
-        i = byte_to_send;
-        if(cdc_mem_type == USB_EP0_ROM)            // Determine type of memory source
-        {
-            while(i)
-            {
-                *pCDCDst.bRam = *pCDCSrc.bRom;
-                pCDCDst.bRam++;
-                pCDCSrc.bRom++;
-                i--;
-            }//end while(byte_to_send)
-        }
-        else
+        /*
+         * If CDC_TX_READY state, nothing to do but send anything
+         * waiting in the transmit ring buffer.  When coalescing a
+         * part-filled packet waits for more data until its time is
+         * up or it is flushed.
+         */
+        if(cdc_trf_state == CDC_TX_READY)
         {
-            while(i)
+            /*
+             * The application is writing into a reserved buffer
+             */
+            if(cdc_tx_reserved)
+                return;
+            #if defined(USB_CDC_TX_RING_SIZE)
+            if(cdc_tx_ring_count == 0)
+                return;
+            /*
+             * Held data goes first, as it is, once the ring
+             * needs the buffer
+             */
+            if(cdc_tx_held != 0)
             {
-                *pCDCDst.bRam = *pCDCSrc.bRam;
-                pCDCDst.bRam++;
-                pCDCSrc.bRam++;
-                i--;
+                byte_to_send = cdc_tx_held;
+                cdc_tx_held = 0;
+                cdc_trf_state = CDC_TX_COMPLETING;
+                CDCTxSend(byte_to_send);
+                continue;
             }
+            #if defined(USB_CDC_TX_COALESCE_FRAMES)
+            if((cdc_tx_ring_count < CDC_DATA_IN_EP_SIZE) && !cdc_tx_flush &&
+               (((USBHALGetFrameNumber() - cdc_tx_ring_frame) & 0x7FF) < USB_CDC_TX_COALESCE_FRAMES))
+                return;
+            #endif
+            CDCTxRingService();
+            #else
+            return;
+            #endif
         }
-        
         /*
-         * Lastly, determine if a zero length packet state is necessary.
-         * See explanation in USB Specification 2.0: Section 5.8.3
+         * If CDC_TX_BUSY_ZLP state, send zero length packet
          */
-        if(cdc_tx_len == 0)
+        else if(cdc_trf_state == CDC_TX_BUSY_ZLP)
         {
-            if(byte_to_send == CDC_DATA_IN_EP_SIZE)
-                cdc_trf_state = CDC_TX_BUSY_ZLP;
+            CDCTxSend(0);
+            //CDC_DATA_BD_IN.CNT = 0;
+            cdc_trf_state = CDC_TX_COMPLETING;
+        }
+        else if(cdc_trf_state == CDC_TX_BUSY)
+        {
+            /*
+             * First, have to figure out how many byte of data to send.
+             */
+        	if(cdc_tx_len > sizeof(cdc_data_tx))
+        	    byte_to_send = sizeof(cdc_data_tx);
+        	else
+        	    byte_to_send = (uint8_t)cdc_tx_len;
+
+            /*
+             * Subtract the number of bytes just about to be sent from the total.
+             */
+        	cdc_tx_len = cdc_tx_len - byte_to_send;
+    	  
+            pCDCDst.bRam = (uint8_t*)cdc_data_tx_buffer[cdc_tx_buf]; // Set destination pointer
+        
+            i = byte_to_send;
+            if(cdc_mem_type == USB_EP0_ROM)            // Determine type of memory source
+            {
+                while(i)
+                {
+                    *pCDCDst.bRam = *pCDCSrc.bRom;
+                    pCDCDst.bRam++;
+                    pCDCSrc.bRom++;
+                    i--;
+                }//end while(byte_to_send)
+            }
             else
+            {
+                while(i)
+                {
+                    *pCDCDst.bRam = *pCDCSrc.bRam;
+                    pCDCDst.bRam++;
+                    pCDCSrc.bRam++;
+                    i--;
+                }
+            }
+        
+            /*
+             * Lastly, determine if a zero length packet state is necessary.
+             * See explanation in USB Specification 2.0: Section 5.8.3
+             */
+            if(cdc_tx_len == 0)
+            {
+                if(byte_to_send == CDC_DATA_IN_EP_SIZE)
+                    cdc_trf_state = CDC_TX_BUSY_ZLP;
+                else
+                    cdc_trf_state = CDC_TX_COMPLETING;
+            }//end if(cdc_tx_len...)
+            CDCTxSend(byte_to_send);
+
+        }//end if(cdc_tx_sate == CDC_TX_BUSY)
+        else if(cdc_trf_state == CDC_TX_STREAMING)
+        {
+            /*
+             * The producer fills the packet in place; the first packet
+             * it doesn't fill, even an empty one, ends the stream.
+             */
+            byte_to_send = cdc_tx_producer((uint8_t*)cdc_data_tx_buffer[cdc_tx_buf], CDC_DATA_IN_EP_SIZE);
+            if(byte_to_send > CDC_DATA_IN_EP_SIZE)
+                byte_to_send = CDC_DATA_IN_EP_SIZE;
+            if(byte_to_send < CDC_DATA_IN_EP_SIZE)
                 cdc_trf_state = CDC_TX_COMPLETING;
-        }//end if(cdc_tx_len...)
-        CDCDataInHandle = USBTxOnePacket(CDC_DATA_EP,(uint8_t*)&cdc_data_tx,byte_to_send);
+            CDCTxSend(byte_to_send);
+        }
+    }
+}
 
-    }//end if(cdc_tx_sate == CDC_TX_BUSY)
+/**************************************************************************
+  Function:
+        uint8_t readCmdUSBUSART(uint8_t *buffer, uint8_t len)
     
+  Summary:
+    readCmdUSBUSART copies up to len bytes received on the command port to
+    buffer, from its receive ring if it has one, else from the Bulk OUT
+    buffer, re-arming that once it has been emptied.
+
+  Description:
+    See usb_device_cdc.h.
+  Conditions:
+    CDCInitEP() must have been called previously.
+  Input:
+    buffer -  Pointer to where received BYTEs are to be stored
+    len -     The most BYTEs to copy.
+  **************************************************************************/
+uint8_t readCmdUSBUSART(uint8_t *buffer, uint8_t len)
+{
+    uint8_t count = 0;
+
+#if defined(USB_CDC_CMD_RX_RING_SIZE)
+    //A terminated request (clear halt) is simply queued again
+    if(!USBTransferRequestBusy(&cdc_cmd_port.rxRequest) && !cdc_cmd_port.rxHeld)
+    {
+        CDCCmdRxQueue();
+    }
+
+    //The ring is filled from the USB interrupt
+    USBMaskInterrupts();
+    while((count < len) && (cdc_cmd_port.rxRingCount > 0))
+    {
+        buffer[count] = cdc_cmd_port.rxRing[cdc_cmd_port.rxRingTail];
+        count++;
+        cdc_cmd_port.rxRingTail++;
+        if(cdc_cmd_port.rxRingTail >= USB_CDC_CMD_RX_RING_SIZE)
+        {
+            cdc_cmd_port.rxRingTail = 0;
+        }
+        cdc_cmd_port.rxRingCount--;
+    }
+    //Last, since queueing the held packet's buffer unmasks the interrupt
+    CDCCmdRxRingFill();
     USBUnmaskInterrupts();
-}//end CDCTxService
+#else
+    if(USBTransferRequestBusy(&cdc_cmd_port.rxRequest))
+    {
+        return 0;
+    }
+
+    if(cdc_cmd_port.rxRequest.status == USB_TRANSFER_REQUEST_COMPLETE)
+    {
+        while((count < len) && (cdc_cmd_port.rxRead < cdc_cmd_port.rxRequest.len))
+        {
+            buffer[count] = cdc_cmd_rx[cdc_cmd_port.rxRead];
+            count++;
+            cdc_cmd_port.rxRead++;
+        }
+    }
+
+    /*
+     * The host is NAKed until the whole packet, or a zero
+     * length one, has been read; a terminated request (clear
+     * halt) is simply queued again
+     */
+    if((cdc_cmd_port.rxRequest.status != USB_TRANSFER_REQUEST_COMPLETE) ||
+       (cdc_cmd_port.rxRead >= cdc_cmd_port.rxRequest.len))
+    {
+        CDCCmdRxQueue();
+    }
+#endif
+
+    return count;
+}//end readCmdUSBUSART
+
+/**************************************************************************
+  Function:
+        uint8_t *reserveCmdUSBUSART(void)
+    
+  Summary:
+    reserveCmdUSBUSART gives the caller the command port's Bulk IN buffer,
+    NULL if it isn't free.
+
+  Description:
+    See usb_device_cdc.h.
+  Conditions:
+    CDCInitEP() must have been called previously.
+  **************************************************************************/
+uint8_t *reserveCmdUSBUSART(void)
+{
+    if(USBTransferRequestBusy(&cdc_cmd_port.txRequest))
+    {
+        return NULL;
+    }
+
+    return (uint8_t*)cdc_cmd_tx;
+}//end reserveCmdUSBUSART
+
+/**************************************************************************
+  Function:
+        void submitCmdUSBUSART(uint8_t length)
+    
+  Summary:
+    submitCmdUSBUSART sends data written into the buffer returned by
+    reserveCmdUSBUSART().
+
+  Description:
+    See usb_device_cdc.h.
+  Conditions:
+    reserveCmdUSBUSART() must have returned a buffer.
+  **************************************************************************/
+void submitCmdUSBUSART(uint8_t length)
+{
+    if(length > sizeof(cdc_cmd_tx))
+        length = sizeof(cdc_cmd_tx);
+
+    cdc_cmd_port.txRequest.pData = (uint8_t*)cdc_cmd_tx;
+    cdc_cmd_port.txRequest.len = length;
+    cdc_cmd_port.txRequest.pFunc = CDCCmdTxComplete;
+    //Refused if the last one is still busy
+    USBQueueTransfer(CDC_CMD_DATA_EP, IN_TO_HOST, &cdc_cmd_port.txRequest);
+}//end submitCmdUSBUSART
+
+/**********************************************************************************
+  Function:
+        static void CDCCmdRxQueue(void)
+    
+  Summary:
+    Queues the command port's Bulk OUT buffer for the next packet.
+  Conditions:
+    The Bulk OUT request must not be busy.
+  **********************************************************************************/
+static void CDCCmdRxQueue(void)
+{
+    cdc_cmd_port.rxRequest.pData = (uint8_t*)cdc_cmd_rx;
+    cdc_cmd_port.rxRequest.len = CDC_CMD_DATA_OUT_EP_SIZE;
+#if defined(USB_CDC_CMD_RX_RING_SIZE)
+    cdc_cmd_port.rxRequest.pFunc = CDCCmdRxComplete;
+#else
+    cdc_cmd_port.rxRead = 0;
+    cdc_cmd_port.rxRequest.pFunc = NULL;
+#endif
+    USBQueueTransfer(CDC_CMD_DATA_EP, OUT_FROM_HOST, &cdc_cmd_port.rxRequest);
+}
+
+#if defined(USB_CDC_CMD_RX_RING_SIZE)
+/************************************************************************
+  Function:
+        static void CDCCmdRxComplete(USB_TRANSFER_REQUEST *pRequest)
+    
+  Summary:
+    Called from USBDeviceTasks(), usually in the USB interrupt, when the
+    command port's Bulk OUT request completes or is terminated.  A packet
+    that has arrived is held until it has been moved into the receive ring,
+    which queues the buffer again; a terminated request is left for
+    readCmdUSBUSART() to queue.
+  ************************************************************************/
+static void CDCCmdRxComplete(USB_TRANSFER_REQUEST *pRequest)
+{
+    if(pRequest->status == USB_TRANSFER_REQUEST_COMPLETE)
+    {
+        cdc_cmd_port.rxHeld = true;
+        CDCCmdRxRingFill();
+    }
+}
+
+/************************************************************************
+  Function:
+        static void CDCCmdRxRingFill(void)
+    
+  Summary:
+    Moves the held Bulk OUT packet, if there is one, into the command
+    port's receive ring and queues the buffer for the next packet, provided
+    the ring has room for all of it.  Otherwise the packet stays where it
+    is and the host is NAKed until readCmdUSBUSART() makes room.
+  Conditions:
+    Must be called with the USB interrupt masked or from USBDeviceTasks().
+  ************************************************************************/
+static void CDCCmdRxRingFill(void)
+{
+    uint8_t len;
+    uint8_t head;
+    uint8_t i;
+
+    len = (uint8_t) cdc_cmd_port.rxRequest.len;
+    if(!cdc_cmd_port.rxHeld ||
+       (len > (uint8_t) (USB_CDC_CMD_RX_RING_SIZE - cdc_cmd_port.rxRingCount)))
+    {
+        return;
+    }
+
+    //Worked out without overflowing a byte
+    if(cdc_cmd_port.rxRingCount >= (uint8_t) (USB_CDC_CMD_RX_RING_SIZE - cdc_cmd_port.rxRingTail))
+    {
+        head = cdc_cmd_port.rxRingCount - (uint8_t) (USB_CDC_CMD_RX_RING_SIZE - cdc_cmd_port.rxRingTail);
+    }
+    else
+    {
+        head = cdc_cmd_port.rxRingTail + cdc_cmd_port.rxRingCount;
+    }
+
+    for(i = 0; i < len; i++)
+    {
+        cdc_cmd_port.rxRing[head] = cdc_cmd_rx[i];
+        head++;
+        if(head >= USB_CDC_CMD_RX_RING_SIZE)
+        {
+            head = 0;
+        }
+    }
+    cdc_cmd_port.rxRingCount += len;
+    cdc_cmd_port.rxHeld = false;
+
+    CDCCmdRxQueue();
+}
+#endif
+
+/************************************************************************
+  Function:
+        static void CDCCmdTxComplete(USB_TRANSFER_REQUEST *pRequest)
+    
+  Summary:
+    Called from USBDeviceTasks() when the command port's Bulk IN request
+    completes or is terminated.  A full packet doesn't end a transfer, see
+    USB Specification 2.0: Section 5.8.3, so the same request is queued
+    again as the zero length packet that does; reserveCmdUSBUSART()
+    returns NULL until that has gone too.
+  ************************************************************************/
+static void CDCCmdTxComplete(USB_TRANSFER_REQUEST *pRequest)
+{
+    if((pRequest->status == USB_TRANSFER_REQUEST_COMPLETE) &&
+       (pRequest->len == CDC_CMD_DATA_IN_EP_SIZE))
+    {
+        pRequest->len = 0;
+        USBQueueTransfer(CDC_CMD_DATA_EP, IN_TO_HOST, pRequest);
+    }
+}
 
 #endif //USB_USE_CDC
 
@@ -95,6 +95,21 @@ please contact mla_licensing@microchip.com
 #define CDC_TX_BUSY                 1
 #define CDC_TX_BUSY_ZLP             2       // ZLP: Zero Length Packet
 #define CDC_TX_COMPLETING           3
+#define CDC_TX_STREAMING            4       // Packets filled by a CDC_TX_PRODUCER
+
+/* SerialState notification bits, see CDCSetSerialState() */
+#define CDC_SERIAL_STATE_DCD        0x01
+#define CDC_SERIAL_STATE_DSR        0x02
+#define CDC_SERIAL_STATE_BREAK      0x04
+#define CDC_SERIAL_STATE_RING       0x08
+#define CDC_SERIAL_STATE_FRAMING    0x10
+#define CDC_SERIAL_STATE_PARITY     0x20
+#define CDC_SERIAL_STATE_OVERRUN    0x40
+// The bits that report an event, rather than a level, and so are
+// cleared again once they have been sent
+#define CDC_SERIAL_STATE_EVENTS     (CDC_SERIAL_STATE_BREAK | CDC_SERIAL_STATE_RING | \
+                                     CDC_SERIAL_STATE_FRAMING | CDC_SERIAL_STATE_PARITY | \
+                                     CDC_SERIAL_STATE_OVERRUN)
 
 #if defined(USB_CDC_SET_LINE_CODING_HANDLER) 
     #define LINE_CODING_TARGET &cdc_notice.SetLineCoding._byte[0]
@@ -394,7 +409,36 @@ please contact mla_licensing@microchip.com
 
 /******************************************************************************
     Function:
-        void mUSBUSARTTxRam(uint8_t *pData, uint8_t len)
+        bool USBUSARTIsTerminalOpen(void)
+        
+    Summary:
+        Returns true if a host application has the port open, i.e. it has
+        asserted DTR with a SET_CONTROL_LINE_STATE request.
+        
+    Description:
+        Returns true if a host application has the port open, i.e. it has
+        asserted DTR with a SET_CONTROL_LINE_STATE request.  Terminal
+        programs assert DTR when they open the port and deassert it when
+        they close it, so the application can use this to avoid generating
+        output that nobody will read.
+        
+         Typical Usage:
+        <code>
+            if(USBUSARTIsTerminalOpen())
+            {
+                writeUSBUSART((const uint8_t*)"Motor on\r\n", 10);
+            }
+        </code>
+        
+    Remarks:
+        DTR is cleared by CDCInitEP(), i.e. each time the device is
+        configured.
+ *****************************************************************************/
+#define USBUSARTIsTerminalOpen()    (control_signal_bitmap.DTE_PRESENT == 1)
+
+/******************************************************************************
+    Function:
+        void mUSBUSARTTxRam(uint8_t *pData, uint16_t len)
     
     Description:
         Deprecated in MCHPFSUSB v2.3.  This macro has been replaced by 
@@ -404,7 +448,7 @@ please contact mla_licensing@microchip.com
 
 /******************************************************************************
     Function:
-        void mUSBUSARTTxRam(uint8_t *pData, uint8_t len)
+        void mUSBUSARTTxRam(uint8_t *pData, uint16_t len)
         
     Description:
         Use this macro to transfer data located in data memory.
@@ -426,7 +470,7 @@ please contact mla_licensing@microchip.com
         
     PreCondition:
         cdc_trf_state must be in the CDC_TX_READY state.
-        Value of 'len' must be equal to or smaller than 255 bytes.
+        Value of 'len' must be equal to or smaller than 65535 bytes.
         The USB stack should have reached the CONFIGURED_STATE prior
         to calling this API function for the first time.
         
@@ -458,7 +502,7 @@ please contact mla_licensing@microchip.com
 
 /******************************************************************************
     Function:
-        void mUSBUSARTTxRom(rom uint8_t *pData, uint8_t len)
+        void mUSBUSARTTxRom(rom uint8_t *pData, uint16_t len)
         
     Description:
         Use this macro to transfer data located in program memory.
@@ -481,7 +525,7 @@ please contact mla_licensing@microchip.com
        
     PreCondition:
         cdc_trf_state must be in the CDC_TX_READY state.
-        Value of 'len' must be equal to or smaller than 255 bytes.
+        Value of 'len' must be equal to or smaller than 65535 bytes.
         
     Parameters:
         pDdata  : Pointer to the starting location of data bytes
@@ -576,9 +620,52 @@ void USBCheckCDCRequest(void);
     the information to the USB host.  This can be done by calling 
     CDCNotificationHandler() by itself, or, by calling CDCTxService() which
     also calls CDCNotificationHandler() internally, when appropriate.
+
+    With USB_CDC_SUPPORT_SERIAL_STATE_EVENTS there is no pin to sample; it
+    sends whatever CDCSetSerialState() has changed.  That happens from
+    CDCSetSerialState() itself and, when USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS
+    is defined, as each notification completes, so there is no need to call
+    it.
   **************************************************************************/
 void CDCNotificationHandler(void);
 
+/**************************************************************************
+  Function: void CDCSetSerialState(uint8_t mask, uint8_t state)
+  Summary: Reports application events to the USB host as SerialState
+           notifications.
+  Description:
+    Sets the CDC_SERIAL_STATE_xxx bits in 'mask' to their values in 'state'
+    and, if anything changed, sends a SerialState notification on the CDC
+    comm (interrupt) endpoint.  A host can wait on that endpoint, e.g. with
+    TIOCMIWAIT on Linux or WaitCommEvent() on Windows, instead of polling the
+    bulk data endpoint.
+
+    DCD and DSR are levels that stay as they are set.  The other bits
+    (CDC_SERIAL_STATE_EVENTS) are events: setting one sends a notification
+    with it set followed by one with it clear, so that hosts which count
+    changes and hosts which count set bits both see one event.  Events that
+    happen while a notification is still on its way are merged.
+
+    Typical Usage:
+    <code>
+        //Motor on
+        CDCSetSerialState(CDC_SERIAL_STATE_DCD, CDC_SERIAL_STATE_DCD);
+        //Motor off
+        CDCSetSerialState(CDC_SERIAL_STATE_DCD, 0);
+        //Something went wrong
+        CDCSetSerialState(CDC_SERIAL_STATE_BREAK, CDC_SERIAL_STATE_BREAK);
+    </code>
+  Conditions:
+    None; the state is kept, and sent once the device is configured.
+  Input:
+    uint8_t mask - the CDC_SERIAL_STATE_xxx bits to change.
+    uint8_t state - their new values.
+  Remarks:
+    Only available when USB_CDC_SUPPORT_SERIAL_STATE_EVENTS is defined in
+    usb_config.h.
+  **************************************************************************/
+void CDCSetSerialState(uint8_t mask, uint8_t state);
+
 
 /**********************************************************************************
   Function:
@@ -652,9 +739,77 @@ bool USBCDCEventHandler(USB_EVENT event, void *pdata, uint16_t size);
   **********************************************************************************/
 uint8_t getsUSBUSART(uint8_t *buffer, uint8_t len);
 
+/**********************************************************************************
+  Function:
+        uint8_t peekUSBUSART(uint8_t **data)
+    
+  Summary:
+    peekUSBUSART gives the caller direct access to the data received through
+    the USB CDC Bulk OUT endpoint, without copying it. It is a non-blocking
+    function that returns '0' if there is no data available.
+
+  Description:
+    peekUSBUSART gives the caller direct access to the data received through
+    the USB CDC Bulk OUT endpoint, without copying it. If a packet has been
+    received *data is set to point at the endpoint buffer and the number of
+    bytes in it is returned. The data can then be parsed, or even modified,
+    in place. The OUT endpoint is not re-armed until commitUSBUSART() is
+    called, so the host is NAKed until then; calling peekUSBUSART() again
+    before commitUSBUSART() returns the same packet.
+    
+    Typical Usage:
+    <code>
+        uint8_t *data;
+        uint8_t numBytes;
+    
+        numBytes = peekUSBUSART(&data);
+        if(numBytes \> 0)
+        {
+            //Use data[0] to data[numBytes - 1] here, then give the
+            //  buffer back so that the next packet can be received.
+            commitUSBUSART();
+        }
+    </code>
+  Conditions:
+    CDCInitEP() must have been called previously.
+  Input:
+    data -    Pointer to a pointer which is set to the received data.
+  Output:
+    uint8_t - The number of bytes received; 0 indicates that no new CDC bulk
+              OUT endpoint data was available, in which case there is
+              nothing to commit.
+  Remarks:
+    Don't mix peekUSBUSART() and getsUSBUSART(), since getsUSBUSART() re-arms
+    the endpoint itself.
+                                                                                   
+  **********************************************************************************/
+uint8_t peekUSBUSART(uint8_t **data);
+
+/**********************************************************************************
+  Function:
+        void commitUSBUSART(void)
+    
+  Summary:
+    commitUSBUSART gives the CDC Bulk OUT endpoint buffer back to the USB
+    module after a successful peekUSBUSART().
+
+  Description:
+    commitUSBUSART gives the CDC Bulk OUT endpoint buffer back to the USB
+    module after a successful peekUSBUSART(), so that the next packet can be
+    received into it. After this call the pointer returned by peekUSBUSART()
+    must no longer be used. Calling it when there is no received data to
+    give back does nothing.
+  Conditions:
+    CDCInitEP() must have been called previously.
+  Input:
+    None
+                                                                                   
+  **********************************************************************************/
+void commitUSBUSART(void);
+
 /******************************************************************************
   Function:
-	void putUSBUSART(char *data, uint8_t length)
+	void putUSBUSART(char *data, uint16_t length)
 		
   Summary:
     putUSBUSART writes an array of data to the USB. Use this version, is
@@ -685,14 +840,14 @@ uint8_t getsUSBUSART(uint8_t *buffer, uint8_t len);
     USBUSARTIsTxTrfReady() must return true. This indicates that the last
     transfer is complete and is ready to receive a new block of data. The
     string of characters pointed to by 'data' must equal to or smaller than
-    255 BYTEs.
+    65535 BYTEs.
 
   Input:
     char *data - pointer to a RAM array of data to be transfered to the host
-    uint8_t length - the number of bytes to be transfered (must be less than 255).
+    uint16_t length - the number of bytes to be transfered (must be less than 65536).
 		
  *****************************************************************************/
-void putUSBUSART(uint8_t *data, uint8_t Length);
+void putUSBUSART(uint8_t *data, uint16_t Length);
 
 /******************************************************************************
 	Function:
@@ -725,11 +880,11 @@ void putUSBUSART(uint8_t *data, uint8_t Length);
     USBUSARTIsTxTrfReady() must return true. This indicates that the last
     transfer is complete and is ready to receive a new block of data. The
     string of characters pointed to by 'data' must equal to or smaller than
-    255 BYTEs.
+    65535 BYTEs.
 
   Input:
     char *data -  null\-terminated string of constant data. If a
-                            null character is not found, 255 BYTEs of data
+                            null character is not found, 65535 BYTEs of data
                             will be transferred to the host.
 		
  *****************************************************************************/
@@ -768,16 +923,382 @@ void putsUSBUSART(char *data);
     USBUSARTIsTxTrfReady() must return true. This indicates that the last
     transfer is complete and is ready to receive a new block of data. The
     string of characters pointed to by 'data' must equal to or smaller than
-    255 BYTEs.
+    65535 BYTEs.
 
   Input:
     const const char *data -  null\-terminated string of constant data. If a
-                            null character is not found, 255 BYTEs of data
+                            null character is not found, 65535 BYTEs of data
                             will be transferred to the host.
                                                                            
   **************************************************************************/
 void putrsUSBUSART(const const char *data);
 
+/******************************************************************************
+  Function:
+	uint8_t (*CDC_TX_PRODUCER)(uint8_t *buffer, uint8_t length)
+
+  Summary:
+    The type of function that fills packets for streamUSBUSART().
+
+  Description:
+    A producer is called once for each packet of a stream with a buffer of
+    'length' (CDC_DATA_IN_EP_SIZE) bytes to fill.  It returns the number of
+    bytes it put there.  Returning less than 'length' ends the stream, so a
+    producer with nothing left returns 0.  It may copy from RAM or program
+    memory or generate the data as it goes.
+
+  Remarks:
+    Called from USBDeviceTasks(), in interrupt context when USB_INTERRUPT
+    is defined, or with USB interrupts masked, so it must be quick and must
+    not call the CDC transmit functions.
+ *****************************************************************************/
+typedef uint8_t (*CDC_TX_PRODUCER)(uint8_t *buffer, uint8_t length);
+
+/******************************************************************************
+  Function:
+	bool streamUSBUSART(CDC_TX_PRODUCER producer)
+
+  Summary:
+    streamUSBUSART sends a stream of data of any length, each packet being
+    filled by 'producer' as it is needed.
+
+  Description:
+    streamUSBUSART sends a stream of data of any length, each packet being
+    filled by 'producer' as it is needed, straight into the endpoint buffer.
+    The stream ends with the first packet the producer doesn't fill; if the
+    last of the data exactly fills a packet the producer's next return of 0
+    becomes the zero length packet that tells the host the transfer is over.
+    USBUSARTIsTxTrfReady() returns false until the stream has been sent.
+
+    Typical Usage:
+    <code>
+        static uint16_t left;
+
+        static uint8_t countDown(uint8_t *buffer, uint8_t length)
+        {
+            uint8_t x = 0;
+
+            while((x < length) && (left > 0))
+            {
+                left--;
+                buffer[x] = (uint8_t) left;
+                x++;
+            }
+            return x;
+        }
+
+        if(USBUSARTIsTxTrfReady())
+        {
+            left = 1000;
+            streamUSBUSART(countDown);
+        }
+    </code>
+
+  Conditions:
+    None
+
+  Input:
+    CDC_TX_PRODUCER producer - the function that fills each packet.
+
+  Output:
+    bool - true if the stream was started, false if the transmit path was
+           busy.
+ *****************************************************************************/
+bool streamUSBUSART(CDC_TX_PRODUCER producer);
+
+/**************************************************************************
+  Function:
+        uint8_t *reserveUSBUSART(void)
+    
+  Summary:
+    reserveUSBUSART gives the caller direct access to the CDC Bulk IN endpoint
+    buffer, so that data can be written straight into it rather than being
+    copied there by CDCTxService().
+
+  Description:
+    reserveUSBUSART gives the caller direct access to the CDC Bulk IN endpoint
+    buffer, so that data can be written straight into it rather than being
+    copied there by CDCTxService(). If the CDC transmit path is idle a pointer
+    to the CDC_DATA_IN_EP_SIZE byte endpoint buffer is returned, otherwise
+    NULL is returned. Once the data is in place submitUSBUSART() arms the
+    endpoint to send it.
+    
+    Typical Usage:
+    <code>
+        uint8_t *buffer;
+    
+        buffer = reserveUSBUSART();
+        if(buffer != NULL)
+        {
+            buffer[0] = 'O';
+            buffer[1] = 'K';
+            submitUSBUSART(2);
+        }
+    </code>
+
+  Conditions:
+    CDCInitEP() must have been called previously.
+
+  Input:
+    None
+
+  Output:
+    uint8_t * - pointer to the endpoint buffer, NULL if it isn't free.
+                                                                           
+  Remarks:
+    While a reservation is held nothing else, the transmit ring included, is
+    sent from the buffer; it ends with submitUSBUSART(), holdUSBUSART() or,
+    if nothing is to be sent, releaseUSBUSART(). Don't call putUSBUSART() or
+    its relatives while holding one.
+  **************************************************************************/
+uint8_t *reserveUSBUSART(void);
+
+/**************************************************************************
+  Function:
+        void submitUSBUSART(uint8_t length)
+    
+  Summary:
+    submitUSBUSART sends data written into the buffer returned by
+    reserveUSBUSART().
+
+  Description:
+    submitUSBUSART arms the CDC Bulk IN endpoint to send the first 'length'
+    bytes of the buffer returned by reserveUSBUSART(). A zero length packet
+    follows automatically if 'length' is CDC_DATA_IN_EP_SIZE. As with the
+    putUSBUSART() family, USBUSARTIsTxTrfReady() returns false until the
+    transfer has completed.
+    
+  Conditions:
+    The buffer must still be reserved, see reserveUSBUSART(), or hold data
+    from holdUSBUSART(); otherwise nothing is sent.
+
+  Input:
+    uint8_t length - the number of bytes to send, at most CDC_DATA_IN_EP_SIZE.
+                                                                           
+  **************************************************************************/
+void submitUSBUSART(uint8_t length);
+
+/**************************************************************************
+  Function:
+        void releaseUSBUSART(void)
+    
+  Summary:
+    releaseUSBUSART gives up the buffer returned by reserveUSBUSART() without
+    sending anything from it.
+
+  Description:
+    releaseUSBUSART ends a reservation that isn't to be submitted or held,
+    letting the transmit ring, which waits while the buffer is reserved, use
+    the buffer again.  Anything held by holdUSBUSART() stays held.
+    
+  Conditions:
+    None
+
+  Input:
+    None
+  **************************************************************************/
+void releaseUSBUSART(void);
+
+/**************************************************************************
+  Function:
+        void holdUSBUSART(uint8_t length)
+    
+  Summary:
+    holdUSBUSART keeps data written into the buffer returned by
+    reserveUSBUSART() there, so that more can be added before it is sent.
+
+  Description:
+    holdUSBUSART keeps data written into the buffer returned by
+    reserveUSBUSART() there, so that more can be added before it is sent.
+    While the first 'length' bytes are held reserveUSBUSART() goes on
+    returning the same buffer, with the held bytes at the start, and
+    USBUSARTTxHeld() returns 'length'.  The held bytes are sent by
+    submitUSBUSART() with the new total length or, ahead of it, as soon as
+    anything is written to the transmit ring; so they must always make
+    sense on their own.  A length of 0 gives the buffer up.
+    
+    Typical Usage:
+    <code>
+        uint8_t *buffer;
+        uint8_t length;
+    
+        buffer = reserveUSBUSART();
+        if(buffer != NULL)
+        {
+            length = USBUSARTTxHeld();
+            buffer[length] = sample;
+            length++;
+            if(length < CDC_DATA_IN_EP_SIZE)
+                holdUSBUSART(length);
+            else
+                submitUSBUSART(length);
+        }
+    </code>
+
+  Conditions:
+    The buffer must still be reserved, see reserveUSBUSART(); otherwise
+    nothing is held.  Held bytes are only rewritten under a new reservation,
+    which keeps them from being sent half changed.
+
+  Input:
+    uint8_t length - the number of bytes to hold, at most CDC_DATA_IN_EP_SIZE.
+                                                                           
+  Remarks:
+    Only available when USB_CDC_TX_RING_SIZE is defined in usb_config.h.
+    As with a reservation, don't call putUSBUSART() or its relatives while
+    holding data.
+  **************************************************************************/
+void holdUSBUSART(uint8_t length);
+
+/******************************************************************************
+    Function:
+        uint8_t USBUSARTTxHeld(void)
+    
+    Summary:
+        Returns the number of bytes held in the reserved buffer by
+        holdUSBUSART(), 0 if there are none.
+
+    Remarks:
+        Only available when USB_CDC_TX_RING_SIZE is defined in usb_config.h.
+ *****************************************************************************/
+#define USBUSARTTxHeld()            (cdc_tx_held)
+
+/**************************************************************************
+  Function:
+        uint8_t writeUSBUSART(const uint8_t *data, uint8_t length)
+    
+  Summary:
+    writeUSBUSART adds data to the CDC transmit ring buffer, from where it
+    is sent to the host.
+
+  Description:
+    writeUSBUSART adds data to the CDC transmit ring buffer, from where it
+    is sent to the host. Unlike putUSBUSART() it can be
+    called at any time, whether or not USBUSARTIsTxTrfReady() is true, and
+    the data is copied so the caller's buffer is free as soon as it returns.
+    Whenever the transmit path is idle up to CDC_DATA_IN_EP_SIZE bytes are
+    taken from the ring and sent as one packet.
+    If the ring is full the data that doesn't fit is dropped and counted,
+    see USBUSARTTxOverflowCount().
+    
+    Typical Usage:
+    <code>
+        writeUSBUSART((const uint8_t*)"Motor on\r\n", 10);
+    </code>
+
+  Conditions:
+    None
+
+  Input:
+    const uint8_t *data - the data to send
+    uint8_t length - the number of bytes to send
+
+  Output:
+    uint8_t - the number of bytes accepted into the ring.
+                                                                           
+  Remarks:
+    Only available when USB_CDC_TX_RING_SIZE is defined in usb_config.h.
+    The ring is only drained when the putUSBUSART() family and
+    submitUSBUSART() are not busy, so the order of data sent through the
+    ring and through them is not preserved.
+  **************************************************************************/
+uint8_t writeUSBUSART(const uint8_t *data, uint8_t length);
+
+/******************************************************************************
+    Function:
+        uint16_t USBUSARTTxOverflowCount(void)
+    
+    Summary:
+        Returns the number of bytes dropped by writeUSBUSART() because the
+        transmit ring buffer was full.
+
+    Description:
+        Returns the number of bytes dropped by writeUSBUSART() because the
+        transmit ring buffer was full, since CDCInitEP() was last called.
+        The count stops at 0xFFFF.
+
+    Remarks:
+        Only available when USB_CDC_TX_RING_SIZE is defined in usb_config.h.
+ *****************************************************************************/
+#define USBUSARTTxOverflowCount()   (cdc_tx_ring_overflow)
+
+/**************************************************************************
+  Function:
+        void flushUSBUSART(void)
+    
+  Summary:
+    flushUSBUSART sends the data in the CDC transmit ring buffer without
+    waiting for more to fill the packet.
+
+  Description:
+    With USB_CDC_TX_COALESCE_FRAMES defined in usb_config.h the data
+    written with writeUSBUSART() is collected into full packets.  A
+    part-filled packet is sent USB_CDC_TX_COALESCE_FRAMES frames after
+    its first byte was written, or straight away after flushUSBUSART().
+    flushUSBUSART doesn't wait for the data to go.
+    
+    Typical Usage:
+    <code>
+        writeUSBUSART((const uint8_t*)"OK\r\n", 4);
+        flushUSBUSART();
+    </code>
+
+  Conditions:
+    None
+
+  Input:
+    None
+                                                                           
+  Remarks:
+    Only available when USB_CDC_TX_RING_SIZE is defined in usb_config.h.
+    Without USB_CDC_TX_COALESCE_FRAMES the ring is never held so this
+    does nothing.  The frame count is only checked on SOF events so when
+    the stack is being polled (see USB_HYBRID_POLLING) a held packet may
+    wait until the next poll.
+  **************************************************************************/
+void flushUSBUSART(void);
+
+/******************************************************************************
+    CDC transmit counters, see getUSBUSARTTxCounters()
+ *****************************************************************************/
+typedef struct
+{
+    uint32_t packets;       //Packets sent on the CDC Bulk IN endpoint, including ZLPs
+    uint32_t bytes;         //Bytes sent in those packets
+} CDC_TX_COUNTERS;
+
+/**************************************************************************
+  Function:
+        void getUSBUSARTTxCounters(CDC_TX_COUNTERS *counters, bool clear)
+    
+  Summary:
+    getUSBUSARTTxCounters reads the number of packets and bytes sent on the
+    CDC Bulk IN endpoint.
+
+  Description:
+    getUSBUSARTTxCounters reads the number of packets and bytes sent on the
+    CDC Bulk IN endpoint, by all of the transmit functions, since the
+    counters were last cleared.  Zero length packets count as packets.
+    Dividing bytes by packets gives the average packet fill, which is what
+    USB_CDC_TX_COALESCE_FRAMES trades against latency.
+    
+    Typical Usage:
+    <code>
+        CDC_TX_COUNTERS counters;
+
+        getUSBUSARTTxCounters(&counters, true);
+    </code>
+
+  Conditions:
+    None
+
+  Input:
+    CDC_TX_COUNTERS *counters - where to put the counts, may be NULL.
+    bool clear - true to zero the counters once they have been read.
+                                                                           
+  **************************************************************************/
+void getUSBUSARTTxCounters(CDC_TX_COUNTERS *counters, bool clear);
+
 /************************************************************************
   Function:
         void CDCTxService(void)
@@ -795,6 +1316,13 @@ void putrsUSBUSART(const const char *data);
     data to the host, associated with CDC serial data.  Failure to call 
     CDCTxService() periodically will prevent data from being sent to the
     USB host, over the CDC serial data interface.
+
+    When USB_ENABLE_TRANSFER_COMPLETE_CALLBACKS is defined in usb_config.h
+    the state machine is also advanced from the transfer complete callback
+    of the CDC Bulk IN endpoint, so the packets of a long transfer go out
+    as fast as the host takes them.  Calling CDCTxService() is then only
+    needed after using mUSBUSARTTxRam() or mUSBUSARTTxRom() directly, or
+    for USB_CDC_SUPPORT_DSR_REPORTING.
     
     Typical Usage:
     <code>
@@ -830,6 +1358,122 @@ void putrsUSBUSART(const const char *data);
   ************************************************************************/
 void CDCTxService(void);
 
+/**************************************************************************
+  Function:
+        uint8_t readCmdUSBUSART(uint8_t *buffer, uint8_t len)
+    
+  Summary:
+    readCmdUSBUSART copies up to len bytes received on the command port, the
+    second CDC function of the device, to buffer. It is a non-blocking
+    function that returns '0' if there is no data.
+
+  Description:
+    The command port has a single CDC_CMD_DATA_OUT_EP_SIZE byte Bulk OUT
+    buffer of its own, received through the stack's transfer queue (see
+    USBQueueTransfer()).
+
+    With USB_CDC_CMD_RX_RING_SIZE defined each packet is copied into the
+    command port's receive ring as it completes, in the USB interrupt, and
+    the buffer is queued again straight away, so the host isn't held up by a
+    busy foreground.  The host is only NAKed when the ring doesn't have room
+    for a packet; that packet then waits in the buffer until readCmdUSBUSART
+    makes room for it.
+
+    Without it readCmdUSBUSART copies data out of the buffer itself and,
+    once all of a packet has been read, queues the buffer again for the
+    next one.  Until then the host is NAKed, so data that hasn't been read
+    waits at the host rather than in RAM here.
+    
+    Typical Usage:
+    <code>
+        uint8_t numBytes;
+        uint8_t buffer[16];
+    
+        numBytes = readCmdUSBUSART(buffer, sizeof(buffer));
+        if(numBytes \> 0)
+        {
+            //Do something with the numBytes bytes in buffer
+        }
+    </code>
+
+  Conditions:
+    CDCInitEP() must have been called previously.
+
+  Input:
+    uint8_t *buffer - where to put the received bytes.
+    uint8_t len - the most bytes to copy.
+
+  Output:
+    uint8_t - the number of bytes copied.
+  **************************************************************************/
+uint8_t readCmdUSBUSART(uint8_t *buffer, uint8_t len);
+
+#if defined(USB_CDC_CMD_RX_RING_SIZE)
+/******************************************************************************
+    Function:
+        uint8_t CmdUSBUSARTRxAvailable(void)
+    
+    Summary:
+        Returns the number of bytes waiting in the command port's receive
+        ring buffer.
+
+    Remarks:
+        Only available when USB_CDC_CMD_RX_RING_SIZE is defined in
+        usb_config.h.
+ *****************************************************************************/
+#define CmdUSBUSARTRxAvailable()    (cdc_cmd_port.rxRingCount)
+#endif
+
+/**************************************************************************
+  Function:
+        uint8_t *reserveCmdUSBUSART(void)
+    
+  Summary:
+    reserveCmdUSBUSART gives the caller direct access to the command port's
+    Bulk IN endpoint buffer, NULL if it isn't free.
+
+  Description:
+    As reserveUSBUSART() but for the command port, which has a single
+    CDC_CMD_DATA_IN_EP_SIZE byte IN buffer and no transmit state machine:
+    what is written into it is sent by submitCmdUSBUSART().  Nothing on the
+    data port, its rings included, can hold up the command port, or the
+    other way around.
+
+  Conditions:
+    CDCInitEP() must have been called previously.
+
+  Input:
+    None
+
+  Output:
+    uint8_t * - pointer to the endpoint buffer, NULL if it isn't free.
+  **************************************************************************/
+uint8_t *reserveCmdUSBUSART(void);
+
+/**************************************************************************
+  Function:
+        void submitCmdUSBUSART(uint8_t length)
+    
+  Summary:
+    submitCmdUSBUSART sends data written into the buffer returned by
+    reserveCmdUSBUSART().
+
+  Description:
+    submitCmdUSBUSART queues a transfer request (see USBQueueTransfer()) to
+    send the first 'length' bytes of the buffer returned by
+    reserveCmdUSBUSART().  A
+    zero length packet follows if 'length' is CDC_CMD_DATA_IN_EP_SIZE and
+    reserveCmdUSBUSART() returns NULL until it has gone.
+
+  Conditions:
+    reserveCmdUSBUSART() must have returned a buffer.
+
+  Input:
+    uint8_t length - the number of bytes to send, at most
+                     CDC_CMD_DATA_IN_EP_SIZE.
+  **************************************************************************/
+void submitCmdUSBUSART(uint8_t length);
+
 
 /** S T R U C T U R E S ******************************************************/
 
@@ -938,6 +1582,26 @@ typedef struct
     uint8_t    Reserved;
 }SERIAL_STATE_NOTIFICATION;   
 
+/* The state of the command port, the second CDC function of the device.  The
+ * first, the data port, keeps the driver's original globals since it alone
+ * has a transmit ring and streams; the command port moves a packet at a time
+ * out and, with USB_CDC_CMD_RX_RING_SIZE, has a receive ring of its own */
+typedef struct
+{
+    LINE_CODING lineCoding;
+    CONTROL_SIGNAL_BITMAP controlSignals;
+    USB_TRANSFER_REQUEST rxRequest; // The Bulk OUT buffer's request
+    USB_TRANSFER_REQUEST txRequest; // The Bulk IN buffer's request
+#if defined(USB_CDC_CMD_RX_RING_SIZE)
+    uint8_t rxRing[USB_CDC_CMD_RX_RING_SIZE];
+    uint8_t rxRingTail;             // Where the next byte is read from
+    volatile uint8_t rxRingCount;   // Number of bytes waiting to be read
+    volatile bool rxHeld;           // rxRequest waits for room in the ring
+#else
+    uint8_t rxRead;                 // Bytes of rxRequest already read
+#endif
+} CDC_CMD_PORT;
+
 //DOM-IGNORE-BEGIN
 /** E X T E R N S ************************************************************/
 extern uint8_t cdc_rx_len;
@@ -945,11 +1609,17 @@ extern USB_HANDLE lastTransmission;
 
 extern uint8_t cdc_trf_state;
 extern POINTER pCDCSrc;
-extern uint8_t cdc_tx_len;
+extern uint16_t cdc_tx_len;
 extern uint8_t cdc_mem_type;
+#if defined(USB_CDC_TX_RING_SIZE)
+extern uint16_t cdc_tx_ring_overflow;
+extern uint8_t cdc_tx_held;
+#endif
 
 extern CDC_NOTICE cdc_notice;
 extern LINE_CODING line_coding;
+extern CONTROL_SIGNAL_BITMAP control_signal_bitmap;
+extern CDC_CMD_PORT cdc_cmd_port;
 
 extern volatile CTRL_TRF_SETUP SetupPkt;
 extern const uint8_t configDescriptor1[];
@@ -964,11 +1634,24 @@ extern const uint8_t configDescriptor1[];
 //void CDCInitEP(void);
 //bool USBCDCEventHandler(USB_EVENT event, void *pdata, uint16_t size);
 //uint8_t getsUSBUSART(char *buffer, uint8_t len);
-//void putUSBUSART(char *data, uint8_t Length);
+//uint8_t peekUSBUSART(uint8_t **data);
+//void commitUSBUSART(void);
+//void putUSBUSART(char *data, uint16_t Length);
 //void putsUSBUSART(char *data);
 //void putrsUSBUSART(const const char *data);
+//bool streamUSBUSART(CDC_TX_PRODUCER producer);
+//uint8_t *reserveUSBUSART(void);
+//void submitUSBUSART(uint8_t length);
+//void releaseUSBUSART(void);
+//uint8_t writeUSBUSART(const uint8_t *data, uint8_t length);
+//void flushUSBUSART(void);
+//void getUSBUSARTTxCounters(CDC_TX_COUNTERS *counters, bool clear);
 //void CDCTxService(void);
+//uint8_t readCmdUSBUSART(uint8_t *buffer, uint8_t len);
+//uint8_t *reserveCmdUSBUSART(void);
+//void submitCmdUSBUSART(uint8_t length);
 //void CDCNotificationHandler(void);
+//void CDCSetSerialState(uint8_t mask, uint8_t state);
 //------------------------------------------------------------------------------
 //DOM-IGNORE-END
 
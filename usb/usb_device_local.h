@@ -42,6 +42,21 @@ typedef union
     uint8_t Val;
 } EP_STATUS;
 
+/* Per endpoint/direction queue of USB_TRANSFER_REQUESTs, see USBQueueTransfer() */
+typedef struct
+{
+    USB_TRANSFER_REQUEST *pHead;    //Oldest request, the first "armed" of them are owned by the SIE
+    USB_TRANSFER_REQUEST *pTail;    //Newest request
+    uint8_t armed;                  //Number of requests currently owned by the SIE
+} USB_TRANSFER_QUEUE;
+
+/* The number of BDT entries a queued endpoint direction can keep armed at once */
+#if (USB_PING_PONG_MODE == USB_PING_PONG__ALL_BUT_EP0) || (USB_PING_PONG_MODE == USB_PING_PONG__FULL_PING_PONG)
+    #define USB_TRANSFER_QUEUE_MAX_ARMED 2
+#else
+    #define USB_TRANSFER_QUEUE_MAX_ARMED 1
+#endif
+
 #if (USB_PING_PONG_MODE == USB_PING_PONG__NO_PING_PONG)
     #define USB_NEXT_EP0_OUT_PING_PONG 0x0000   // Used in USB Device Mode only
     #define USB_NEXT_EP0_IN_PING_PONG 0x0000    // Used in USB Device Mode only
@@ -359,6 +374,24 @@ typedef union
     #error "No ping pong mode defined."
 #endif
 
+/* Hybrid polling: note that the bus is busy, so the USB interrupt should stay
+   (or go back to being) enabled for at least USB_HYBRID_IDLE_TIMEOUT ms */
+#if defined(USB_HYBRID_POLLING)
+    #if !defined(USB_INTERRUPT)
+        #error "USB_HYBRID_POLLING requires USB_INTERRUPT to be defined."
+    #endif
+    #define USBHybridActivity() {USBHybridIdleCounter = USB_HYBRID_IDLE_TIMEOUT; USBHybridInterruptMode = true;}
+#else
+    #define USBHybridActivity()
+#endif
+
+#if defined(USB_ENABLE_STATISTICS)
+    //Counters that stick at their maximum value rather than wrap
+    #define USBStatisticsIncrement(counter) {if((counter) != 0xFFFF) {(counter)++;}}
+#else
+    #define USBStatisticsIncrement(counter)
+#endif
+
 /****** Event callback enabling/disabling macros ********************
     This section of code is used to disable specific USB events that may not be
     desired by the user.  This can save code size and increase throughput and
@@ -106,6 +106,14 @@ please contact mla_licensing@microchip.com
 #define USBErrorIFReg UIR
 #define USBErrorIFBitNum 0xFD					//UERRIF bit position 1.  Note: This bit is read only and is cleared by clearing the enabled UEIR flags
 
+//----- UEIR error source bits ------------------------------------------------
+#define USB_ERROR_PID_MASK      0x01
+#define USB_ERROR_CRC5_MASK     0x02
+#define USB_ERROR_CRC16_MASK    0x04
+#define USB_ERROR_DFN8_MASK     0x08
+#define USB_ERROR_BTO_MASK      0x10
+#define USB_ERROR_BTS_MASK      0x80
+
 //----- Event call back definitions --------------------------------------------
 #if defined(USB_DISABLE_SOF_HANDLER)
     #define USB_SOF_INTERRUPT 0x00
@@ -126,6 +134,10 @@ please contact mla_licensing@microchip.com
 #define USBPacketDisable UCONbits.PKTDIS
 #define USBResumeControl UCONbits.RESUME
 
+//Busy-wait for roughly a millisecond, used to time remote wakeup signalling.
+//Assumes the 48 MHz system clock (12 MIPS) that full speed USB needs.
+#define USBHALDelay1ms() _delay(12000)
+
 //----- BDnSTAT bit definitions -----------------------------------------------
 #define _BSTALL     0x04        //Buffer Stall enable
 #define _DTSEN      0x08        //Data Toggle Synch enable
@@ -286,6 +298,7 @@ typedef union __USTAT
 #define USBHALGetLastEndpoint(stat)     stat.endpoint_number
 #define USBHALGetLastDirection(stat)    stat.direction
 #define USBHALGetLastPingPong(stat)     stat.ping_pong
+#define USBHALGetFrameNumber()          (((uint16_t)UFRMH << 8) | UFRML)
 
 
 typedef union _POINTER
@@ -320,7 +333,13 @@ typedef union _POINTER
 #define ConvertToPhysicalAddress(a) (((uint16_t)(a)) & 0x7FFF)
 #define ConvertToVirtualAddress(a)  ((void *)(a))
 #define USBClearUSBInterrupt() PIR2bits.USBIF = 0;
-#if defined(USB_INTERRUPT)
+#if defined(USB_INTERRUPT) && defined(USB_HYBRID_POLLING)
+    //In hybrid polling mode the USB interrupt is only unmasked again if the
+    //stack is in its interrupt driven phase, see USBHybridPoll()
+    #define USBMaskInterrupts() {PIE2bits.USBIE = 0;}
+    #define USBUnmaskInterrupts() {PIE2bits.USBIE = USBHybridInterruptMode;}
+    #define USBForceUnmaskInterrupts() {PIE2bits.USBIE = 1;}
+#elif defined(USB_INTERRUPT)
     #define USBMaskInterrupts() {PIE2bits.USBIE = 0;}
     #define USBUnmaskInterrupts() {PIE2bits.USBIE = 1;}
 #else